@@ -0,0 +1,247 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "activity.h"
+
+/* Open a read-only view of fname.  Returns 0 on success, 1 on failure
+ * (including an empty file, which no loader can use).
+ */
+int
+activity_view_open (const char *fname, ActivityFileView *view)
+{
+  memset (view, 0, sizeof (ActivityFileView));
+#ifndef _WIN32
+  int fd = open (fname, O_RDONLY);
+  if (fd < 0)
+    return 1;
+  struct stat st;
+  if (fstat (fd, &st) != 0 || st.st_size <= 0)
+    {
+      close (fd);
+      return 1;
+    }
+  void *p = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  /* The mapping holds its own reference to the file. */
+  close (fd);
+  if (p == MAP_FAILED)
+    return 1;
+  /* The loaders read front to back. */
+  madvise (p, st.st_size, MADV_SEQUENTIAL);
+  view->data = (const char *)p;
+  view->size = st.st_size;
+  view->mapped = 1;
+  return 0;
+#else
+  /* No mmap here; fall back to a single read into the heap. */
+  FILE *fp = fopen (fname, "rb");
+  if (fp == NULL)
+    return 1;
+  long size = -1;
+  if (fseek (fp, 0, SEEK_END) == 0)
+    size = ftell (fp);
+  if (size <= 0 || fseek (fp, 0, SEEK_SET) != 0)
+    {
+      fclose (fp);
+      return 1;
+    }
+  char *buf = (char *)malloc (size);
+  if (buf == NULL || fread (buf, 1, size, fp) != (size_t)size)
+    {
+      free (buf);
+      fclose (fp);
+      return 1;
+    }
+  fclose (fp);
+  view->data = buf;
+  view->size = size;
+  view->mapped = 0;
+  return 0;
+#endif
+}
+
+/* Release a view from activity_view_open. */
+void
+activity_view_close (ActivityFileView *view)
+{
+  if (view->data == NULL)
+    return;
+#ifndef _WIN32
+  if (view->mapped)
+    munmap ((void *)view->data, view->size);
+  else
+    free ((void *)view->data);
+#else
+  free ((void *)view->data);
+#endif
+  memset (view, 0, sizeof (ActivityFileView));
+}
+
+/* Record how far a load has got.  A NULL prog is ignored. */
+void
+activity_progress_update (ActivityProgress *prog, int64_t done, int64_t total)
+{
+  if (prog == NULL)
+    return;
+  __atomic_store_n (&prog->total, total, __ATOMIC_RELAXED);
+  __atomic_store_n (&prog->done, done, __ATOMIC_RELAXED);
+}
+
+/* How far along the load is, 0 to 1. */
+double
+activity_progress_fraction (ActivityProgress *prog)
+{
+  int64_t total = __atomic_load_n (&prog->total, __ATOMIC_RELAXED);
+  int64_t done = __atomic_load_n (&prog->done, __ATOMIC_RELAXED);
+  if (total <= 0)
+    return 0.0;
+  return done >= total ? 1.0 : (double)done / (double)total;
+}
+
+/* Ask the loader to give up at its next opportunity. */
+void
+activity_progress_cancel (ActivityProgress *prog)
+{
+  __atomic_store_n (&prog->cancel, 1, __ATOMIC_RELAXED);
+}
+
+/* Has the load been cancelled?  A NULL prog never is. */
+int
+activity_progress_cancelled (ActivityProgress *prog)
+{
+  return prog != NULL && __atomic_load_n (&prog->cancel, __ATOMIC_RELAXED);
+}
+
+/* Loader side: records [0, nrecs) are complete and may be displayed.  The
+ * records since the last call are queued as one batch; if the queue is full
+ * they wait to be merged into the next one (the last few may never be
+ * queued, but they are in the finished activity).  A NULL prog is ignored.
+ */
+void
+activity_progress_publish (ActivityProgress *prog, long nrecs)
+{
+  if (prog == NULL || nrecs <= prog->published)
+    return;
+  uint32_t head = prog->head;
+  if (head - __atomic_load_n (&prog->tail, __ATOMIC_ACQUIRE)
+      >= ACTIVITY_QUEUE_SLOTS)
+    return;
+  ActivityBatch *slot = &prog->queue[head % ACTIVITY_QUEUE_SLOTS];
+  slot->first = prog->published;
+  slot->count = nrecs - prog->published;
+  prog->published = nrecs;
+  /* The records and the slot must be visible before the slot is. */
+  __atomic_store_n (&prog->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Watcher side: take the oldest published batch.  Batches arrive in record
+ * order with no gaps.  Returns 1 if one was taken, 0 if none is waiting.
+ */
+int
+activity_progress_next_batch (ActivityProgress *prog, ActivityBatch *batch)
+{
+  uint32_t tail = prog->tail;
+  if (tail == __atomic_load_n (&prog->head, __ATOMIC_ACQUIRE))
+    return 0;
+  *batch = prog->queue[tail % ACTIVITY_QUEUE_SLOTS];
+  /* Hand the slot back only once it has been copied out. */
+  __atomic_store_n (&prog->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/* Start from an empty activity: no columns and no session values. */
+void
+activity_init (ActivityData *act)
+{
+  memset (act, 0, sizeof (ActivityData));
+  act->sess.start_position_lat = NAN;
+  act->sess.start_position_long = NAN;
+  act->sess.total_elapsed_time = NAN;
+  act->sess.total_timer_time = NAN;
+  act->sess.total_distance = NAN;
+  act->sess.nec_latitude = NAN;
+  act->sess.nec_longitude = NAN;
+  act->sess.swc_latitude = NAN;
+  act->sess.swc_longitude = NAN;
+  act->sess.total_work = NAN;
+  act->sess.total_moving_time = NAN;
+  act->sess.average_lap_time = NAN;
+  act->sess.total_calories = NAN;
+  act->sess.avg_speed = NAN;
+  act->sess.max_speed = NAN;
+  act->sess.total_ascent = NAN;
+  act->sess.total_descent = NAN;
+  act->sess.avg_altitude = NAN;
+  act->sess.max_altitude = NAN;
+  act->sess.min_altitude = NAN;
+  act->sess.avg_heartrate = NAN;
+  act->sess.max_heartrate = NAN;
+  act->sess.min_heartrate = NAN;
+  act->sess.avg_cadence = NAN;
+  act->sess.max_cadence = NAN;
+  act->sess.avg_temperature = NAN;
+  act->sess.max_temperature = NAN;
+  act->sess.total_anaerobic_training_effect = NAN;
+}
+
+/* Size the record and lap columns for exactly nrecs and nlaps entries.
+ * Returns 0 on success, 1 if memory could not be had.
+ */
+int
+activity_alloc (ActivityData *act, long nrecs, long nlaps)
+{
+  /* Never ask malloc for zero bytes; an empty column is still a column. */
+  size_t rcount = nrecs > 0 ? nrecs : 1;
+  size_t rsize = rcount * sizeof (float);
+  size_t lsize = (nlaps > 0 ? nlaps : 1) * sizeof (float);
+  act->rec_time = (double *)malloc (rcount * sizeof (double));
+  act->rec_distance = (float *)malloc (rsize);
+  act->rec_speed = (float *)malloc (rsize);
+  act->rec_altitude = (float *)malloc (rsize);
+  act->rec_cadence = (float *)malloc (rsize);
+  act->rec_heartrate = (float *)malloc (rsize);
+  act->rec_lat = (float *)malloc (rsize);
+  act->rec_long = (float *)malloc (rsize);
+  act->lap_total_distance = (float *)malloc (lsize);
+  act->lap_start_position_lat = (float *)malloc (lsize);
+  act->lap_start_position_long = (float *)malloc (lsize);
+  act->lap_total_elapsed_time = (float *)malloc (lsize);
+  act->nrecs = 0;
+  act->nlaps = 0;
+  if (act->rec_time == NULL || act->rec_distance == NULL
+      || act->rec_speed == NULL || act->rec_altitude == NULL
+      || act->rec_cadence == NULL || act->rec_heartrate == NULL
+      || act->rec_lat == NULL || act->rec_long == NULL
+      || act->lap_total_distance == NULL
+      || act->lap_start_position_lat == NULL
+      || act->lap_start_position_long == NULL
+      || act->lap_total_elapsed_time == NULL)
+    return 1;
+  return 0;
+}
+
+/* Release the columns and return the activity to its empty state. */
+void
+activity_free (ActivityData *act)
+{
+  free (act->rec_time);
+  free (act->rec_distance);
+  free (act->rec_speed);
+  free (act->rec_altitude);
+  free (act->rec_cadence);
+  free (act->rec_heartrate);
+  free (act->rec_lat);
+  free (act->rec_long);
+  free (act->lap_total_distance);
+  free (act->lap_start_position_lat);
+  free (act->lap_start_position_long);
+  free (act->lap_total_elapsed_time);
+  activity_init (act);
+}
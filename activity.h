@@ -0,0 +1,135 @@
+#ifndef ACTIVITY_H_
+#define ACTIVITY_H_
+
+/*
+ * The in-memory representation of an activity shared by the FIT and TCX
+ * loaders.  Samples are stored column-wise, one array per channel, all in
+ * SI units (meters, meters/second, degrees) so that unit conversion happens
+ * in exactly one place: the raw_to_user_* routines in main.c.
+ *
+ * This header is also included by fitwrapper.go, so it must contain
+ * declarations only.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Summary values for a workout session.  NaN marks a value the file does not
+ * provide.
+ */
+typedef struct ActivitySession
+{
+  time_t timestamp;
+  time_t start_time;
+  float start_position_lat;
+  float start_position_long;
+  float total_elapsed_time;
+  float total_timer_time;
+  float total_distance;
+  float nec_latitude;
+  float nec_longitude;
+  float swc_latitude;
+  float swc_longitude;
+  float total_work;
+  float total_moving_time;
+  float average_lap_time;
+  float total_calories;
+  float avg_speed;
+  float max_speed;
+  float total_ascent;
+  float total_descent;
+  float avg_altitude;
+  float max_altitude;
+  float min_altitude;
+  float avg_heartrate;
+  float max_heartrate;
+  float min_heartrate;
+  float avg_cadence;
+  float max_cadence;
+  float avg_temperature;
+  float max_temperature;
+  float total_anaerobic_training_effect;
+} ActivitySession;
+
+typedef struct ActivityData
+{
+  /* Record (time based) columns, nrecs entries each. */
+  long nrecs;
+  double *rec_time;     // seconds since the epoch, UTC
+  float *rec_distance;  // meters
+  float *rec_speed;     // meters/second
+  float *rec_altitude;  // meters
+  float *rec_cadence;   // steps/minute
+  float *rec_heartrate; // beats/minute
+  float *rec_lat;       // degrees
+  float *rec_long;      // degrees
+  /* Lap table, nlaps entries each. */
+  long nlaps;
+  float *lap_total_distance;       // meters
+  float *lap_start_position_lat;   // degrees
+  float *lap_start_position_long;  // degrees
+  float *lap_total_elapsed_time;   // seconds
+  /* Session block for the session loaded, one of nsessions in the file. */
+  long nsessions;
+  long session;
+  ActivitySession sess;
+  time_t time_zone_offset; // seconds east of UTC
+} ActivityData;
+
+/* A read-only view of a whole input file.  Where the platform allows it the
+ * file is mapped rather than read, so the loaders parse straight out of the
+ * page cache without a heap copy of the file.
+ */
+typedef struct ActivityFileView
+{
+  const char *data;
+  size_t size;
+  int mapped; // 1 if data is a mapping, 0 if it was read into the heap
+} ActivityFileView;
+
+int activity_view_open (const char *fname, ActivityFileView *view);
+void activity_view_close (ActivityFileView *view);
+
+/* A run of records a loader has finished filling in. */
+typedef struct ActivityBatch
+{
+  long first; // index of the first record
+  long count;
+} ActivityBatch;
+
+#define ACTIVITY_QUEUE_SLOTS 64
+
+/* Progress of a load, shared between the thread doing it and any thread
+ * watching.  The loader reports how far through total it has got, polls
+ * cancel, and publishes each run of records as it completes them; the
+ * watcher reads the fraction done, takes the published records in order,
+ * and may request cancellation.  The records travel through a lock-free
+ * single-producer, single-consumer ring: head belongs to the loader, tail
+ * to the watcher.  Access only through the activity_progress_* functions.
+ */
+typedef struct ActivityProgress
+{
+  int64_t done;
+  int64_t total;
+  int32_t cancel;
+  uint32_t head;
+  uint32_t tail;
+  ActivityBatch queue[ACTIVITY_QUEUE_SLOTS];
+  long published; // loader only: records handed to the queue so far
+} ActivityProgress;
+
+void activity_progress_update (ActivityProgress *prog, int64_t done,
+                               int64_t total);
+double activity_progress_fraction (ActivityProgress *prog);
+void activity_progress_cancel (ActivityProgress *prog);
+int activity_progress_cancelled (ActivityProgress *prog);
+void activity_progress_publish (ActivityProgress *prog, long nrecs);
+int activity_progress_next_batch (ActivityProgress *prog,
+                                  ActivityBatch *batch);
+
+void activity_init (ActivityData *act);
+int activity_alloc (ActivityData *act, long nrecs, long nlaps);
+void activity_free (ActivityData *act);
+
+#endif /* !ACTIVITY_H_ */
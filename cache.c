@@ -0,0 +1,279 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+/* Bump whenever the layout below or ActivityData's columns change, or a
+ * loader comes to decode the same file differently.
+ */
+#define CACHE_VERSION 3
+#define CACHE_MAGIC "SSACTCH"
+#define CACHE_ALIGN(n) (((n) + 7) & ~(size_t)7)
+/* How much of each end of the source file goes into its hash. */
+#define CACHE_SAMPLE 65536
+
+typedef struct CacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t session_size; // sizeof (ActivitySession), guards the raw copy
+  uint64_t file_size;
+  int64_t file_mtime;
+  uint64_t file_hash;
+  int64_t path_len;
+  int64_t session;
+  int64_t nsessions;
+  int64_t nrecs;
+  int64_t nlaps;
+  int64_t time_zone_offset;
+  ActivitySession sess;
+} CacheHeader;
+
+static guint cache_hits = 0;
+static guint cache_misses = 0;
+
+static uint64_t
+fnv1a (const void *data, size_t len, uint64_t hash)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < len; i++)
+    {
+      hash ^= p[i];
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+}
+
+#define FNV_BASIS 14695981039346656037ULL
+
+/* Where the entry for a file's session lives.  The caller frees it. */
+static gchar *
+cache_path (const char *fname, long session)
+{
+  gchar *dir = g_build_filename (g_get_user_cache_dir (), "siliconsneaker",
+                                 NULL);
+  uint64_t key = fnv1a (fname, strlen (fname), FNV_BASIS);
+  key = fnv1a (&session, sizeof (session), key);
+  gchar *base = g_strdup_printf ("%016" G_GINT64_MODIFIER "x.act",
+                                 (guint64)key);
+  gchar *path = g_build_filename (dir, base, NULL);
+  g_free (base);
+  g_free (dir);
+  return path;
+}
+
+/* Size and modification time of the source file. */
+static int
+source_stat (const char *fname, uint64_t *size, int64_t *mtime)
+{
+  GStatBuf st;
+  if (g_stat (fname, &st) != 0)
+    return 1;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return 0;
+}
+
+/* Hash of the first and last CACHE_SAMPLE bytes of the source file (all of
+ * it when it is smaller), so a hit costs two short reads whatever the size.
+ * Rewrites that keep the size and the modification time are rare; those
+ * that also leave both ends alone are not worth a read of the whole file.
+ */
+static int
+source_hash (const char *fname, uint64_t size, uint64_t *hash)
+{
+  FILE *fp = g_fopen (fname, "rb");
+  if (fp == NULL)
+    return 1;
+  char *buf = g_malloc (CACHE_SAMPLE);
+  size_t head = size < CACHE_SAMPLE ? size : CACHE_SAMPLE;
+  size_t tail = size - head < CACHE_SAMPLE ? size - head : CACHE_SAMPLE;
+  int failed = fread (buf, 1, head, fp) != head;
+  *hash = fnv1a (buf, head, FNV_BASIS);
+  if (!failed && tail > 0)
+    failed = fseek (fp, -(long)tail, SEEK_END) != 0
+             || fread (buf, 1, tail, fp) != tail;
+  *hash = fnv1a (buf, tail, *hash);
+  g_free (buf);
+  fclose (fp);
+  return failed;
+}
+
+/* Column layout of an entry, in order, after the header and path. */
+static size_t
+columns_size (int64_t nrecs, int64_t nlaps)
+{
+  return CACHE_ALIGN (nrecs * sizeof (double))
+         + 7 * CACHE_ALIGN (nrecs * sizeof (float))
+         + 4 * CACHE_ALIGN (nlaps * sizeof (float));
+}
+
+/* Fill act (initialized by the caller with activity_init) from the cache.
+ * Returns 0 on a hit, 1 on a miss (no entry, a stale one, or a bad one).
+ */
+int
+cache_load (const char *fname, long session, ActivityData *act)
+{
+  gchar *path = cache_path (fname, session);
+  ActivityFileView view;
+  int opened = activity_view_open (path, &view);
+  g_free (path);
+  if (opened != 0)
+    {
+      g_atomic_int_inc (&cache_misses);
+      return 1;
+    }
+
+  const CacheHeader *h = (const CacheHeader *)view.data;
+  size_t plen = 0;
+  uint64_t size, hash;
+  int64_t mtime;
+  /* The cheap checks first; the content hash last. */
+  if (view.size < sizeof (CacheHeader)
+      || memcmp (h->magic, CACHE_MAGIC, sizeof (h->magic)) != 0
+      || h->version != CACHE_VERSION
+      || h->session_size != sizeof (ActivitySession) || h->session != session
+      || h->path_len != (int64_t)(plen = strlen (fname))
+      || h->nrecs < 0 || h->nlaps < 0
+      /* Counts the entry has no room for could overflow the sizes. */
+      || (uint64_t)h->nrecs > view.size / sizeof (double)
+      || (uint64_t)h->nlaps > view.size / sizeof (float)
+      || view.size != sizeof (CacheHeader) + CACHE_ALIGN (plen)
+                          + columns_size (h->nrecs, h->nlaps)
+      || memcmp (view.data + sizeof (CacheHeader), fname, plen) != 0
+      || source_stat (fname, &size, &mtime) != 0
+      || h->file_size != size || h->file_mtime != mtime
+      || source_hash (fname, size, &hash) != 0 || h->file_hash != hash
+      || activity_alloc (act, h->nrecs, h->nlaps) != 0)
+    {
+      activity_view_close (&view);
+      g_atomic_int_inc (&cache_misses);
+      return 1;
+    }
+
+  const char *p = view.data + sizeof (CacheHeader) + CACHE_ALIGN (plen);
+#define CACHE_GET(col, n)                                                     \
+  do                                                                          \
+    {                                                                         \
+      memcpy (act->col, p, (n) * sizeof (*act->col));                         \
+      p += CACHE_ALIGN ((n) * sizeof (*act->col));                            \
+    }                                                                         \
+  while (0)
+  CACHE_GET (rec_time, h->nrecs);
+  CACHE_GET (rec_distance, h->nrecs);
+  CACHE_GET (rec_speed, h->nrecs);
+  CACHE_GET (rec_altitude, h->nrecs);
+  CACHE_GET (rec_cadence, h->nrecs);
+  CACHE_GET (rec_heartrate, h->nrecs);
+  CACHE_GET (rec_lat, h->nrecs);
+  CACHE_GET (rec_long, h->nrecs);
+  CACHE_GET (lap_total_distance, h->nlaps);
+  CACHE_GET (lap_start_position_lat, h->nlaps);
+  CACHE_GET (lap_start_position_long, h->nlaps);
+  CACHE_GET (lap_total_elapsed_time, h->nlaps);
+#undef CACHE_GET
+  act->nrecs = h->nrecs;
+  act->nlaps = h->nlaps;
+  act->nsessions = h->nsessions;
+  act->session = h->session;
+  act->time_zone_offset = h->time_zone_offset;
+  act->sess = h->sess;
+
+  activity_view_close (&view);
+  g_atomic_int_inc (&cache_hits);
+  return 0;
+}
+
+/* Write act as the entry for a file's session.  The entry is written to a
+ * uniquely named temporary file and renamed into place, so a reader never
+ * sees half of it and two writers of the same entry never share a file.
+ * Returns 0 on success, 1 on failure (the cache is best effort).
+ */
+int
+cache_store (const char *fname, long session, ActivityData *act)
+{
+  static const char pad[8] = { 0 };
+  CacheHeader h;
+  memset (&h, 0, sizeof (h));
+  memcpy (h.magic, CACHE_MAGIC, sizeof (h.magic));
+  h.version = CACHE_VERSION;
+  h.session_size = sizeof (ActivitySession);
+  if (source_stat (fname, &h.file_size, &h.file_mtime) != 0
+      || source_hash (fname, h.file_size, &h.file_hash) != 0)
+    return 1;
+  h.path_len = strlen (fname);
+  h.session = session;
+  h.nsessions = act->nsessions;
+  h.nrecs = act->nrecs;
+  h.nlaps = act->nlaps;
+  h.time_zone_offset = act->time_zone_offset;
+  h.sess = act->sess;
+
+  gchar *path = cache_path (fname, session);
+  gchar *dir = g_path_get_dirname (path);
+  gchar *tmp = g_strconcat (path, ".XXXXXX", NULL);
+  int failed = g_mkdir_with_parents (dir, 0700) != 0;
+  int fd = failed ? -1 : g_mkstemp (tmp);
+  FILE *fp = fd < 0 ? NULL : fdopen (fd, "wb");
+  if (fp == NULL)
+    {
+      if (fd >= 0)
+        {
+          g_close (fd, NULL);
+          g_unlink (tmp);
+        }
+      failed = 1;
+    }
+  else
+    {
+#define CACHE_PUT(data, n)                                                    \
+  do                                                                          \
+    {                                                                         \
+      size_t len = (n);                                                       \
+      if (fwrite ((data), 1, len, fp) != len                                  \
+          || fwrite (pad, 1, CACHE_ALIGN (len) - len, fp)                     \
+                 != CACHE_ALIGN (len) - len)                                  \
+        failed = 1;                                                           \
+    }                                                                         \
+  while (0)
+      CACHE_PUT (&h, sizeof (h));
+      CACHE_PUT (fname, h.path_len);
+      CACHE_PUT (act->rec_time, h.nrecs * sizeof (double));
+      CACHE_PUT (act->rec_distance, h.nrecs * sizeof (float));
+      CACHE_PUT (act->rec_speed, h.nrecs * sizeof (float));
+      CACHE_PUT (act->rec_altitude, h.nrecs * sizeof (float));
+      CACHE_PUT (act->rec_cadence, h.nrecs * sizeof (float));
+      CACHE_PUT (act->rec_heartrate, h.nrecs * sizeof (float));
+      CACHE_PUT (act->rec_lat, h.nrecs * sizeof (float));
+      CACHE_PUT (act->rec_long, h.nrecs * sizeof (float));
+      CACHE_PUT (act->lap_total_distance, h.nlaps * sizeof (float));
+      CACHE_PUT (act->lap_start_position_lat, h.nlaps * sizeof (float));
+      CACHE_PUT (act->lap_start_position_long, h.nlaps * sizeof (float));
+      CACHE_PUT (act->lap_total_elapsed_time, h.nlaps * sizeof (float));
+#undef CACHE_PUT
+      if (fclose (fp) != 0)
+        failed = 1;
+      if (failed || g_rename (tmp, path) != 0)
+        {
+          g_unlink (tmp);
+          failed = 1;
+        }
+    }
+  g_free (tmp);
+  g_free (dir);
+  g_free (path);
+  return failed;
+}
+
+/* Lookups served from the cache, and those that fell through to a parse. */
+void
+cache_stats (unsigned long *hits, unsigned long *misses)
+{
+  *hits = g_atomic_int_get (&cache_hits);
+  *misses = g_atomic_int_get (&cache_misses);
+}
@@ -0,0 +1,23 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+/*
+ * An on-disk cache of decoded activities, so that reopening a file is a read
+ * of its columns rather than a full FIT or TCX decode.
+ *
+ * Each entry holds one session of one file in a flat, versioned binary
+ * layout: a fixed header, the file's path, then the record and lap columns
+ * back to back, every part 8-byte aligned so the entry can be used straight
+ * from a mapping.  Entries live in the user's cache directory
+ * ($XDG_CACHE_HOME/siliconsneaker) and are keyed by path and session, then
+ * checked against the file's size and modification time, then a hash of
+ * the first and last 64 KiB of its contents, before use.
+ */
+
+#include "activity.h"
+
+int cache_load (const char *fname, long session, ActivityData *act);
+int cache_store (const char *fname, long session, ActivityData *act);
+void cache_stats (unsigned long *hits, unsigned long *misses);
+
+#endif /* !CACHE_H_ */
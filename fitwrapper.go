@@ -30,402 +30,837 @@
 
 package main
 
+/*
+#include "activity.h"
+*/
+import "C"
+
 import (
-	"C"
-	"bytes"
+	"encoding/binary"
+	"errors"
 	//"fmt"
-	"github.com/tormoder/fit"
-  "math"
-	"io/ioutil"
+	"math"
 	"os"
+	"sort"
+	"sync"
+	"time"
 	"unsafe"
 )
 
 /* Create a "Go slice backed by a C array" for floats
  * ref: https://github.com/golang/go/wiki/cgo#turning-c-arrays-into-go-slices
  */
-func malloc_float_slice(size int) (p unsafe.Pointer, float_slice []C.float) {
-	p = C.malloc(C.size_t(size) * C.size_t(unsafe.Sizeof(C.float(0))))
-	float_slice = (*[1<<30 - 1]C.float)(p)[:size:size]
-	return p, float_slice
+func float_slice(p *C.float, size int) []C.float {
+	return unsafe.Slice(p, size)
 }
 
-/* Create a "Go slice backed by a C array" for floats
- * ref: https://github.com/golang/go/wiki/cgo#turning-c-arrays-into-go-slices
+/* As float_slice, for doubles. */
+func double_slice(p *C.double, size int) []C.double {
+	return unsafe.Slice(p, size)
+}
+
+/*
+ * A reader for FIT activity files, so that records can be converted (and
+ * shown) as the file is read.  It walks the messages of each FIT file
+ * chained in the data, keeping each local message type's definition, and
+ * reads only the fields the program shows; everything else is stepped over
+ * by size.
  */
-func malloc_long_slice(size int) (p unsafe.Pointer, long_slice []C.long) {
-	p = C.malloc(C.size_t(size) * C.size_t(unsafe.Sizeof(C.long(0))))
-	long_slice = (*[1<<30 - 1]C.long)(p)[:size:size]
-	return p, long_slice
+
+const (
+	fitMesgFileID     = 0
+	fitMesgSession    = 18
+	fitMesgLap        = 19
+	fitMesgRecord     = 20
+	fitMesgActivity   = 34
+	fitFieldTimestamp = 253
+	fitFileActivity   = 4 // file_id type of an activity file
+	/* FIT timestamps count seconds from 1989-12-31T00:00:00Z. */
+	fitEpoch = 631065600
+)
+
+var (
+	errFitFormat = errors.New("not a FIT activity file the reader can follow")
+	errFitCRC    = errors.New("FIT file fails its CRC check")
+	errCancelled = errors.New("load cancelled")
+)
+
+/* The FIT CRC-16 (CRC-16/ARC), a byte at a time. */
+var fitCRCTable = func() (t [256]uint16) {
+	for i := range t {
+		crc := uint16(i)
+		for k := 0; k < 8; k++ {
+			if crc&1 != 0 {
+				crc = crc>>1 ^ 0xA001
+			} else {
+				crc >>= 1
+			}
+		}
+		t[i] = crc
+	}
+	return t
+}()
+
+func fit_crc(crc uint16, data []byte) uint16 {
+	for _, b := range data {
+		crc = crc>>8 ^ fitCRCTable[byte(crc)^b]
+	}
+	return crc
+}
+
+/* The messages of one FIT file in a chain, between its header and CRC. */
+type fitExtent struct {
+	start, end int
 }
 
-/* Find the structure containing sensor data and
- * events from active sessions.
+/* Find the FIT files chained in data, checking each one's header and CRCs
+ * so that nothing is read out of a damaged file.  Anything after the last
+ * that does not start another FIT file is ignored.
  */
-func open_fit_file(fit_filename string) (af *fit.ActivityFile) {
-	infile, err := os.Open(fit_filename) // For read access.
-	if err != nil {
-    return nil
+func fit_files(data []byte) ([]fitExtent, error) {
+	var files []fitExtent
+	pos := 0
+	for len(data)-pos >= 12 && string(data[pos+8:pos+12]) == ".FIT" {
+		hsize := int(data[pos])
+		end := int64(pos) + int64(hsize) + int64(binary.LittleEndian.Uint32(data[pos+4:pos+8]))
+		if hsize < 12 || end+2 > int64(len(data)) {
+			return nil, errFitFormat
+		}
+		if hsize >= 14 {
+			/* A header CRC of 0 was never computed. */
+			hcrc := binary.LittleEndian.Uint16(data[pos+12 : pos+14])
+			if hcrc != 0 && hcrc != fit_crc(0, data[pos:pos+12]) {
+				return nil, errFitCRC
+			}
+		}
+		/* The file CRC follows the messages, so running over both leaves 0. */
+		if fit_crc(0, data[pos:end+2]) != 0 {
+			return nil, errFitCRC
+		}
+		files = append(files, fitExtent{pos + hsize, int(end)})
+		pos = int(end) + 2
+	}
+	if len(files) == 0 {
+		return nil, errFitFormat
+	}
+	return files, nil
+}
+
+/* Where one field sits in the data of a message. */
+type fitField struct {
+	num, offset, size int
+	baseType          byte
+}
+
+/* A definition message, as much of it as the reader needs. */
+type fitDefinition struct {
+	valid     bool
+	global    uint16
+	bigEndian bool
+	size      int // bytes of data per message, developer fields included
+	fields    []fitField
+	at        [256]uint8 // by field number, 1 + its index in fields, or 0
+}
+
+/* Bytes in a value of each FIT base type, by base type number.  Number 7
+ * is a string, which is never read as a number.
+ */
+var fitTypeSize = [...]int{1, 1, 1, 2, 2, 4, 4, 0, 4, 8, 1, 2, 4, 1, 8, 8, 8}
+
+/* The value of field num in msg, or false if the message lacks it or holds
+ * its base type's invalid value.  Only the first element of an array is
+ * read.
+ */
+func (def *fitDefinition) number(msg []byte, num int) (float64, bool) {
+	i := def.at[num]
+	if i == 0 {
+		return 0, false
+	}
+	f := &def.fields[i-1]
+	bt := int(f.baseType & 0x1f)
+	if bt >= len(fitTypeSize) || fitTypeSize[bt] == 0 || f.size < fitTypeSize[bt] {
+		return 0, false
+	}
+	w := uint(fitTypeSize[bt])
+	var v uint64
+	for k, b := range msg[f.offset : f.offset+int(w)] {
+		if def.bigEndian {
+			v = v<<8 | uint64(b)
+		} else {
+			v |= uint64(b) << (8 * uint(k))
+		}
+	}
+	all := uint64(1)<<(8*w) - 1
+	switch bt {
+	case 1, 3, 5, 14:
+		/* Signed: invalid is the largest positive value. */
+		if v == all>>1 {
+			return 0, false
+		}
+		return float64(int64(v<<(64-8*w)) >> (64 - 8*w)), true
+	case 8:
+		if v == all {
+			return 0, false
+		}
+		return float64(math.Float32frombits(uint32(v))), true
+	case 9:
+		if v == all {
+			return 0, false
+		}
+		return math.Float64frombits(v), true
+	case 10, 11, 12, 16:
+		/* The "z" types: invalid is zero. */
+		if v == 0 {
+			return 0, false
+		}
+	default:
+		if v == all {
+			return 0, false
+		}
+	}
+	return float64(v), true
+}
+
+/* The bytes of field num in msg, or nil if the message lacks it. */
+func (def *fitDefinition) bytes(msg []byte, num int) []byte {
+	i := def.at[num]
+	if i == 0 {
+		return nil
 	}
-	/* fBytes is an in-memory array of bytes read from the file. */
-	fBytes, err := ioutil.ReadAll(infile)
+	f := &def.fields[i-1]
+	return msg[f.offset : f.offset+f.size]
+}
+
+/* Field num of msg divided by scale, less offset, or NaN if it is missing
+ * or invalid.
+ */
+func (def *fitDefinition) scaled(msg []byte, num int, scale float64, offset float64) C.float {
+	v, ok := def.number(msg, num)
+	if !ok {
+		return C.float(math.NaN())
+	}
+	return C.float(v/scale - offset)
+}
+
+/* As scaled, but with field alt (an "enhanced" field, of wider range but
+ * the same units) standing in when num is missing or invalid.
+ */
+func (def *fitDefinition) scaled_or(msg []byte, num int, alt int, scale float64, offset float64) C.float {
+	if _, ok := def.number(msg, num); ok {
+		return def.scaled(msg, num, scale, offset)
+	}
+	return def.scaled(msg, alt, scale, offset)
+}
+
+/* A position field of msg in degrees, or NaN if it is missing or invalid. */
+func (def *fitDefinition) degrees(msg []byte, num int) C.float {
+	return def.scaled(msg, num, (1<<31)/180.0, 0)
+}
+
+/* A time field of msg in seconds since the Unix epoch, or 0. */
+func (def *fitDefinition) time(msg []byte, num int) int64 {
+	v, ok := def.number(msg, num)
+	if !ok {
+		return 0
+	}
+	return int64(v) + fitEpoch
+}
+
+type fitStream struct {
+	data     []byte
+	files    []fitExtent
+	file     int // the one being read
+	pos, end int // within it
+	defs     [16]fitDefinition
+	lastTime uint32 // the latest timestamp, for compressed headers
+}
+
+func new_fit_stream(data []byte, files []fitExtent) *fitStream {
+	return &fitStream{data: data, files: files, pos: files[0].start, end: files[0].end}
+}
+
+/* Read a definition message with record header h. */
+func (s *fitStream) define(h byte) error {
+	if s.end-s.pos < 5 {
+		return errFitFormat
+	}
+	d := s.data[s.pos:]
+	def := fitDefinition{valid: true, bigEndian: d[1] == 1}
+	if def.bigEndian {
+		def.global = binary.BigEndian.Uint16(d[2:4])
+	} else {
+		def.global = binary.LittleEndian.Uint16(d[2:4])
+	}
+	n := int(d[4])
+	s.pos += 5
+	if s.end-s.pos < 3*n {
+		return errFitFormat
+	}
+	def.fields = make([]fitField, n)
+	for i := range def.fields {
+		f := s.data[s.pos+3*i:]
+		def.fields[i] = fitField{int(f[0]), def.size, int(f[1]), f[2]}
+		def.size += int(f[1])
+		if def.at[f[0]] == 0 {
+			def.at[f[0]] = uint8(i + 1)
+		}
+	}
+	s.pos += 3 * n
+	if h&0x20 != 0 {
+		/* Developer fields: only their sizes matter here. */
+		if s.end-s.pos < 1 {
+			return errFitFormat
+		}
+		nd := int(s.data[s.pos])
+		s.pos++
+		if s.end-s.pos < 3*nd {
+			return errFitFormat
+		}
+		for i := 0; i < nd; i++ {
+			def.size += int(s.data[s.pos+3*i+1])
+		}
+		s.pos += 3 * nd
+	}
+	s.defs[h&0x0f] = def
+	return nil
+}
+
+/* Move to the next data message, taking in any definitions on the way.
+ * Returns its definition, its bytes and its timestamp, or a nil definition
+ * once the data is used up.
+ */
+func (s *fitStream) next() (*fitDefinition, []byte, uint32, error) {
+	for {
+		if s.pos >= s.end {
+			if s.file+1 >= len(s.files) {
+				return nil, nil, 0, nil
+			}
+			/* Each file of a chain defines its messages afresh. */
+			s.file++
+			s.pos, s.end = s.files[s.file].start, s.files[s.file].end
+			s.defs = [16]fitDefinition{}
+			continue
+		}
+		h := s.data[s.pos]
+		s.pos++
+		if h&0x80 == 0 && h&0x40 != 0 {
+			if err := s.define(h); err != nil {
+				return nil, nil, 0, err
+			}
+			continue
+		}
+		var def *fitDefinition
+		if h&0x80 != 0 {
+			def = &s.defs[(h>>5)&0x03]
+		} else {
+			def = &s.defs[h&0x0f]
+		}
+		if !def.valid || s.end-s.pos < def.size {
+			return nil, nil, 0, errFitFormat
+		}
+		msg := s.data[s.pos : s.pos+def.size]
+		s.pos += def.size
+		if h&0x80 != 0 {
+			/* Compressed header: the low five bits of the time since the
+			 * last timestamp, rolling over every 32 seconds.
+			 */
+			offset := uint32(h & 0x1f)
+			t := s.lastTime&^0x1f + offset
+			if offset < s.lastTime&0x1f {
+				t += 0x20
+			}
+			s.lastTime = t
+		} else if t, ok := def.number(msg, fitFieldTimestamp); ok {
+			s.lastTime = uint32(t)
+		}
+		return def, msg, s.lastTime, nil
+	}
+}
+
+/* Count the record and lap messages in the FIT files, so that their
+ * columns can be sized before they are decoded.
+ */
+func count_fit_messages(data []byte, files []fitExtent) (recs int, laps int, err error) {
+	s := new_fit_stream(data, files)
+	for {
+		def, _, _, err := s.next()
+		if err != nil || def == nil {
+			return recs, laps, err
+		}
+		switch def.global {
+		case fitMesgRecord:
+			recs++
+		case fitMesgLap:
+			laps++
+		}
+	}
+}
+
+/* The summary of a session, and when it started. */
+type fitSession struct {
+	start int64 // seconds since the Unix epoch
+	sess  C.ActivitySession
+}
+
+func decode_fit_session(def *fitDefinition, msg []byte, t uint32) fitSession {
+	var fs fitSession
+	fs.start = def.time(msg, 2)
+	ss := &fs.sess
+	ss.timestamp = C.time_t(int64(t) + fitEpoch)
+	ss.start_time = C.time_t(fs.start)
+	ss.start_position_lat = def.degrees(msg, 3)
+	ss.start_position_long = def.degrees(msg, 4)
+	ss.total_elapsed_time = def.scaled(msg, 7, 1000, 0)
+	ss.total_timer_time = def.scaled(msg, 8, 1000, 0)
+	ss.total_distance = def.scaled(msg, 9, 100, 0)
+	ss.nec_latitude = def.degrees(msg, 29)
+	ss.nec_longitude = def.degrees(msg, 30)
+	ss.swc_latitude = def.degrees(msg, 31)
+	ss.swc_longitude = def.degrees(msg, 32)
+	ss.total_work = def.scaled(msg, 48, 1, 0)
+	ss.total_moving_time = def.scaled(msg, 59, 1000, 0)
+	ss.average_lap_time = def.scaled(msg, 69, 1000, 0)
+	ss.total_calories = def.scaled(msg, 11, 1, 0)
+	ss.avg_speed = def.scaled_or(msg, 14, 124, 1000, 0)
+	ss.max_speed = def.scaled_or(msg, 15, 125, 1000, 0)
+	ss.total_ascent = def.scaled(msg, 22, 1, 0)
+	ss.total_descent = def.scaled(msg, 23, 1, 0)
+	ss.avg_altitude = def.scaled_or(msg, 49, 126, 5, 500)
+	ss.max_altitude = def.scaled_or(msg, 50, 128, 5, 500)
+	ss.min_altitude = def.scaled_or(msg, 71, 127, 5, 500)
+	ss.avg_heartrate = def.scaled(msg, 16, 1, 0)
+	ss.max_heartrate = def.scaled(msg, 17, 1, 0)
+	ss.min_heartrate = def.scaled(msg, 64, 1, 0)
+	ss.avg_cadence = def.scaled(msg, 18, 1, 0)
+	ss.max_cadence = def.scaled(msg, 19, 1, 0)
+	ss.avg_temperature = def.scaled(msg, 57, 1, 0)
+	ss.max_temperature = def.scaled(msg, 58, 1, 0)
+	/* Shown as stored, in tenths. */
+	ss.total_anaerobic_training_effect = def.scaled(msg, 137, 1, 0)
+	return fs
+}
+
+/* Decode the FIT files into fh: the records and laps into its columns,
+ * which must have room for the numbers count_fit_messages found, and the
+ * sessions and time zone beside them.  Every fitBatchSize records, and at
+ * the end, progress through the data is reported to prog and the number of
+ * records converted so far is passed to batch, which may be nil.  Fails if
+ * the load is cancelled or batch returns false.
+ */
+func decode_fit(data []byte, files []fitExtent, fh *fitHandle, prog *C.ActivityProgress, batch func(n int) bool) error {
+	s := new_fit_stream(data, files)
+	act := &fh.all
+	n, nl := fh.recsFound, fh.lapsFound
+	RecTimes := double_slice(act.rec_time, n)
+	RecDistances := float_slice(act.rec_distance, n)
+	RecSpeeds := float_slice(act.rec_speed, n)
+	RecAltitudes := float_slice(act.rec_altitude, n)
+	RecCadences := float_slice(act.rec_cadence, n)
+	RecHeartRates := float_slice(act.rec_heartrate, n)
+	RecLats := float_slice(act.rec_lat, n)
+	RecLongs := float_slice(act.rec_long, n)
+	LapTotalDistances := float_slice(act.lap_total_distance, nl)
+	LapStartPositionLats := float_slice(act.lap_start_position_lat, nl)
+	LapStartPositionLongs := float_slice(act.lap_start_position_long, nl)
+	LapTotalElapsedTimes := float_slice(act.lap_total_elapsed_time, nl)
+	fh.lapStarts = make([]int64, nl)
+	flush := func(j int) error {
+		act.nrecs = C.long(j)
+		C.activity_progress_update(prog, C.int64_t(s.pos), C.int64_t(len(data)))
+		if C.activity_progress_cancelled(prog) != 0 || (batch != nil && !batch(j)) {
+			return errCancelled
+		}
+		return nil
+	}
+	/* Compressed speed and distance (from some bike sensors) count distance
+	 * in sixteenths of a meter, in 12 bits that roll over; it is summed here.
+	 */
+	var distLast, distSum uint32
+	activity := false
+	j, l := 0, 0
+	for {
+		def, msg, t, err := s.next()
+		if err != nil {
+			return err
+		}
+		if def == nil {
+			break
+		}
+		switch def.global {
+		case fitMesgFileID:
+			if v, ok := def.number(msg, 0); ok && v == fitFileActivity {
+				activity = true
+			}
+		case fitMesgRecord:
+			if j == n {
+				return errFitFormat
+			}
+			RecTimes[j] = C.double(int64(t) + fitEpoch)
+			/* The enhanced fields stand in when the plain ones are missing. */
+			RecDistances[j] = def.scaled(msg, 5, 100, 0)
+			RecSpeeds[j] = def.scaled_or(msg, 6, 73, 1000, 0)
+			RecAltitudes[j] = def.scaled_or(msg, 2, 78, 5, 500)
+			if b := def.bytes(msg, 8); len(b) >= 3 && (b[0]&b[1]&b[2]) != 0xff {
+				d := uint32(b[1]>>4) | uint32(b[2])<<4
+				distSum += (d - distLast) & 0xfff
+				distLast = d
+				if math.IsNaN(float64(RecSpeeds[j])) {
+					RecSpeeds[j] = C.float(float64(uint32(b[0])|uint32(b[1]&0x0f)<<8) / 100)
+				}
+				if math.IsNaN(float64(RecDistances[j])) {
+					RecDistances[j] = C.float(float64(distSum) / 16)
+				}
+			}
+			/* Heart rate and cadence go over raw, invalid value and all. */
+			cadence, ok := def.number(msg, 4)
+			if !ok {
+				cadence = math.MaxUint8
+			}
+			RecCadences[j] = C.float(cadence)
+			hr, ok := def.number(msg, 3)
+			if !ok {
+				hr = math.MaxUint8
+			}
+			RecHeartRates[j] = C.float(hr)
+			RecLats[j] = def.degrees(msg, 0)
+			RecLongs[j] = def.degrees(msg, 1)
+			j++
+			if j%fitBatchSize == 0 {
+				if err := flush(j); err != nil {
+					return err
+				}
+			}
+		case fitMesgLap:
+			if l == nl {
+				return errFitFormat
+			}
+			fh.lapStarts[l] = def.time(msg, 2)
+			LapTotalDistances[l] = def.scaled(msg, 9, 100, 0)
+			LapStartPositionLats[l] = def.degrees(msg, 3)
+			LapStartPositionLongs[l] = def.degrees(msg, 4)
+			LapTotalElapsedTimes[l] = def.scaled(msg, 7, 1000, 0)
+			l++
+		case fitMesgSession:
+			fh.sessions = append(fh.sessions, decode_fit_session(def, msg, t))
+		case fitMesgActivity:
+			/* Local time less UTC is the offset of the local time zone. */
+			if local, ok := def.number(msg, 5); ok {
+				fh.tzOffset = int64(local) - int64(t)
+			}
+		}
+	}
+	act.nlaps = C.long(l)
+	if !activity || len(fh.sessions) == 0 {
+		return errFitFormat
+	}
+	return flush(j)
+}
+
+/* Export the functions to C via CGO with // notation. */
+
+/*
+ * A decoded file.  Opening a file decodes it once, in a single pass: the
+ * records and laps are converted into C columns the handle owns as they
+ * are read, and the sessions are kept beside them.  Any of its sessions can
+ * then be copied out, until the handle is closed.
+ */
+type fitHandle struct {
+	mu        sync.RWMutex // held for reading while a load copies out of it
+	closed    bool
+	all       C.ActivityData // every record and lap in the file
+	lapStarts []int64        // when each lap started, seconds since the epoch
+	sessions  []fitSession
+	tzOffset  int64     // seconds east of UTC
+	spans     []fitSpan // one per session, in file order
+	/* Found by a count before decoding, to size columns while it runs. */
+	recsFound, lapsFound int
+}
+
+/* The half-open ranges of records and laps belonging to one session. */
+type fitSpan struct {
+	recStart, recEnd int
+	lapStart, lapEnd int
+}
+
+/* Index session boundaries within the record and lap streams.  Each session
+ * owns everything from its start time up to the next session's start time,
+ * so every record and lap belongs to exactly one session.  Records and laps
+ * are in time order, so a binary search per boundary is enough.
+ */
+func index_sessions(fh *fitHandle) []fitSpan {
+	times := double_slice(fh.all.rec_time, int(fh.all.nrecs))
+	spans := make([]fitSpan, len(fh.sessions))
+	recStart, lapStart := 0, 0
+	for i := range fh.sessions {
+		recEnd, lapEnd := len(times), len(fh.lapStarts)
+		if i+1 < len(fh.sessions) {
+			next := fh.sessions[i+1].start
+			recEnd = sort.Search(len(times), func(j int) bool {
+				return float64(times[j]) >= float64(next)
+			})
+			lapEnd = sort.Search(len(fh.lapStarts), func(j int) bool {
+				return fh.lapStarts[j] >= next
+			})
+		}
+		if recEnd < recStart {
+			recEnd = recStart
+		}
+		if lapEnd < lapStart {
+			lapEnd = lapStart
+		}
+		spans[i] = fitSpan{recStart, recEnd, lapStart, lapEnd}
+		recStart, lapStart = recEnd, lapEnd
+	}
+	return spans
+}
+
+/* Copy n of the handle's records, from index from, into act's record
+ * columns at index offset.  The columns must have room for offset+n.
+ */
+func copy_records(fh *fitHandle, from int, n int, act *C.ActivityData, offset int) {
+	total := int(fh.all.nrecs)
+	end := offset + n
+	copy(double_slice(act.rec_time, end)[offset:], double_slice(fh.all.rec_time, total)[from:from+n])
+	copy(float_slice(act.rec_distance, end)[offset:], float_slice(fh.all.rec_distance, total)[from:from+n])
+	copy(float_slice(act.rec_speed, end)[offset:], float_slice(fh.all.rec_speed, total)[from:from+n])
+	copy(float_slice(act.rec_altitude, end)[offset:], float_slice(fh.all.rec_altitude, total)[from:from+n])
+	copy(float_slice(act.rec_cadence, end)[offset:], float_slice(fh.all.rec_cadence, total)[from:from+n])
+	copy(float_slice(act.rec_heartrate, end)[offset:], float_slice(fh.all.rec_heartrate, total)[from:from+n])
+	copy(float_slice(act.rec_lat, end)[offset:], float_slice(fh.all.rec_lat, total)[from:from+n])
+	copy(float_slice(act.rec_long, end)[offset:], float_slice(fh.all.rec_long, total)[from:from+n])
+}
+
+/* Copy a span's laps into act's lap columns, which must have room for
+ * them.  Returns the number of laps.
+ */
+func copy_laps(fh *fitHandle, sp fitSpan, act *C.ActivityData) C.long {
+	total := int(fh.all.nlaps)
+	n := sp.lapEnd - sp.lapStart
+	copy(float_slice(act.lap_total_distance, n), float_slice(fh.all.lap_total_distance, total)[sp.lapStart:sp.lapEnd])
+	copy(float_slice(act.lap_start_position_lat, n), float_slice(fh.all.lap_start_position_lat, total)[sp.lapStart:sp.lapEnd])
+	copy(float_slice(act.lap_start_position_long, n), float_slice(fh.all.lap_start_position_long, total)[sp.lapStart:sp.lapEnd])
+	copy(float_slice(act.lap_total_elapsed_time, n), float_slice(fh.all.lap_total_elapsed_time, total)[sp.lapStart:sp.lapEnd])
+	return C.long(n)
+}
+
+/* Fill act's session block (and time zone offset) from session idx. */
+func copy_session(fh *fitHandle, idx int, act *C.ActivityData) {
+	act.sess = fh.sessions[idx].sess
+	act.time_zone_offset = C.time_t(fh.tzOffset)
+}
+
+/* Decode a FIT activity file, reporting progress through prog (which may be
+ * NULL).  While the records are decoded (before anything else) pass sink,
+ * if not nil, the handle and the number of records converted so far every
+ * fitBatchSize records.  Returning false from sink abandons the decode.
+ * Returns the decoded file, or nil on failure or cancellation.
+ */
+func open_fit_handle(fname *C.char, prog *C.ActivityProgress, sink func(fh *fitHandle, n int) bool) *fitHandle {
+	/* Decode straight out of a read-only mapping of the file rather than
+	 * reading a heap copy of it.  Everything kept is copied out, so the
+	 * view is released as soon as decoding is done.
+	 */
+	var view C.ActivityFileView
+	if C.activity_view_open(fname, &view) != 0 {
+		C.activity_view_close(&view)
+		return nil
+	}
+	defer C.activity_view_close(&view)
+	data := unsafe.Slice((*byte)(unsafe.Pointer(view.data)), view.size)
+	fh := &fitHandle{}
+	C.activity_init(&fh.all)
+	/* A damaged file is turned away before any of it is shown. */
+	files, err := fit_files(data)
 	if err != nil {
-    return nil
+		return nil
 	}
-	// Decode the FIT file data
-	fit, err := fit.Decode(bytes.NewReader(fBytes))
+	recs, laps, err := count_fit_messages(data, files)
 	if err != nil {
 		return nil
 	}
-	af, err = fit.Activity()
+	if C.activity_alloc(&fh.all, C.long(recs), C.long(laps)) != 0 {
+		C.activity_free(&fh.all)
+		return nil
+	}
+	fh.recsFound, fh.lapsFound = recs, laps
+	var batch func(n int) bool
+	if sink != nil {
+		batch = func(n int) bool { return sink(fh, n) }
+	}
+	if decode_fit(data, files, fh, prog, batch) != nil {
+		C.activity_free(&fh.all)
+		return nil
+	}
+	fh.spans = index_sessions(fh)
+	return fh
+}
+
+/* Release a decoded file, once no one is reading it. */
+func close_fit_handle(fh *fitHandle) {
+	fh.mu.Lock()
+	defer fh.mu.Unlock()
+	fh.closed = true
+	C.activity_free(&fh.all)
+	fh.lapStarts, fh.sessions = nil, nil
+}
+
+/* Lock a decoded file for reading.  Returns false, holding no lock, if it
+ * has been closed.
+ */
+func read_lock_fit_handle(fh *fitHandle) bool {
+	fh.mu.RLock()
+	if fh.closed {
+		fh.mu.RUnlock()
+		return false
+	}
+	return true
+}
+
+/* The FIT file last loaded, kept decoded while it is on display so that
+ * switching to another of its sessions copies records already converted
+ * rather than decoding the file again.  A changed file (by size or
+ * modification time) is decoded afresh.
+ */
+var fitKept struct {
+	sync.Mutex
+	name  string
+	size  int64
+	mtime time.Time
+	fh    *fitHandle
+}
+
+/* The decoded file for fname, from fitKept if it is there and decoding it
+ * (and keeping it) if not, passing sink the records as they are decoded
+ * (see open_fit_handle).  The handle is returned read-locked, so it
+ * cannot be closed under the caller, or nil on failure.
+ */
+func kept_fit_handle(fname *C.char, prog *C.ActivityProgress, sink func(fh *fitHandle, n int) bool) *fitHandle {
+	name := C.GoString(fname)
+	st, err := os.Stat(name)
 	if err != nil {
 		return nil
 	}
-	return af
-}
-
-func make_arrays(af *fit.ActivityFile, recSize int, lapSize int) (
-	pRecTimestamp unsafe.Pointer,
-	pRecDistance unsafe.Pointer,
-	pRecSpeed unsafe.Pointer,
-	pRecAltitude unsafe.Pointer,
-	pRecCadence unsafe.Pointer,
-	pRecHeartRate unsafe.Pointer,
-	pRecLat unsafe.Pointer,
-	pRecLong unsafe.Pointer,
-	nRecs int,
-	pLapTimestamp unsafe.Pointer,
-	pLapTotalDistance unsafe.Pointer,
-	pLapStartPositionLat unsafe.Pointer,
-	pLapStartPositionLong unsafe.Pointer,
-	pLapEndPositionLat unsafe.Pointer,
-	pLapEndPositionLong unsafe.Pointer,
-	pLapTotalCalories unsafe.Pointer,
-	pLapTotalElapsedTime unsafe.Pointer,
-	pLapTotalTimerTime unsafe.Pointer,
-	nLaps int) {
-
-	/* Allocate the *C.float array (on the GO side so that it doesn't
-	 * get garbage collected.
-	 */
-	pRecTimestamp, RecTimestamps := malloc_long_slice(recSize)
-	pRecDistance, RecDistances := malloc_float_slice(recSize)
-	pRecSpeed, RecSpeeds := malloc_float_slice(recSize)
-	pRecAltitude, RecAltitudes := malloc_float_slice(recSize)
-	pRecCadence, RecCadences := malloc_float_slice(recSize)
-	pRecHeartRate, RecHeartRates := malloc_float_slice(recSize)
-	pRecLat, RecLats := malloc_float_slice(recSize)
-	pRecLong, RecLongs := malloc_float_slice(recSize)
-
-	pLapTimestamp, LapTimestamps := malloc_long_slice(lapSize)
-	pLapTotalDistance, LapTotalDistances := malloc_float_slice(lapSize)
-	pLapStartPositionLat, LapStartPositionLats := malloc_float_slice(lapSize)
-	pLapStartPositionLong, LapStartPositionLongs := malloc_float_slice(lapSize)
-	pLapEndPositionLat, LapEndPositionLats := malloc_float_slice(lapSize)
-	pLapEndPositionLong, LapEndPositionLongs := malloc_float_slice(lapSize)
-	pLapTotalCalories, LapTotalCaloriess := malloc_float_slice(lapSize)
-	pLapTotalElapsedTime, LapTotalElapsedTimes := malloc_float_slice(lapSize)
-	pLapTotalTimerTime, LapTotalTimerTimes := malloc_float_slice(lapSize)
-
-	nRecs = 0
-	for idx, item := range af.Records {
-		RecTimestamps[idx] = C.long(item.Timestamp.Unix())
-		RecDistances[idx] = C.float(item.GetDistanceScaled())
-		RecSpeeds[idx] = C.float(item.GetSpeedScaled())
-		RecAltitudes[idx] = C.float(item.GetAltitudeScaled())
-		RecCadences[idx] = C.float(item.Cadence)
-		RecHeartRates[idx] = C.float(item.HeartRate)
-		RecLats[idx] = C.float(item.PositionLat.Degrees())
-		RecLongs[idx] = C.float(item.PositionLong.Degrees())
-		nRecs = nRecs + 1
-	}
-	nLaps = 0
-	for idx, item := range af.Laps {
-		LapTimestamps[idx] = C.long(item.Timestamp.Unix())
-		LapTotalDistances[idx] = C.float(item.GetTotalDistanceScaled())
-		LapStartPositionLats[idx] = C.float(item.StartPositionLat.Degrees())
-		LapStartPositionLongs[idx] = C.float(item.StartPositionLong.Degrees())
-		LapEndPositionLats[idx] = C.float(item.EndPositionLat.Degrees())
-		LapEndPositionLongs[idx] = C.float(item.EndPositionLong.Degrees())
-		LapTotalCaloriess[idx] = C.float(item.TotalCalories)
-		LapTotalElapsedTimes[idx] = C.float(item.GetTotalElapsedTimeScaled())
-		LapTotalTimerTimes[idx] = C.float(item.GetTotalTimerTimeScaled())
-		nLaps = nLaps + 1
-	}
-	return pRecTimestamp,
-		pRecDistance,
-		pRecSpeed,
-		pRecAltitude,
-		pRecCadence,
-		pRecHeartRate,
-		pRecLat,
-		pRecLong,
-		nRecs,
-		pLapTimestamp,
-		pLapTotalDistance,
-		pLapStartPositionLat,
-		pLapStartPositionLong,
-		pLapEndPositionLat,
-		pLapEndPositionLong,
-		pLapTotalCalories,
-		pLapTotalElapsedTime,
-		pLapTotalTimerTime,
-		nLaps
-
-}
-
-/* Return a floating point representation or NaN */
-func num_cvt(sessionval interface{}) (C.float) {
-  switch sessionval.(type) {
-    case string:
-      return C.float(math.NaN())
-    case float32:
-      return C.float(sessionval.(float32))
-    case float64:
-      return C.float(sessionval.(float64))
-    case uint8:
-      if (sessionval.(uint8) < math.MaxUint8) {
-        return C.float(sessionval.(uint8))
-      } else {
-        break;
-      }
-    case uint16:
-      if (sessionval.(uint16) < math.MaxUint16) {
-        return C.float(sessionval.(uint16))
-      } else {
-        break;
-      }
-    case uint32:
-      if (sessionval.(uint32) < math.MaxUint32) {
-        return C.float(sessionval.(uint32))
-      } else {
-        break;
-      }
-    /*
-    case uint64:
-      if (sessionval != math.MaxUint64) {
-        return C.float(sessionval.(uint64))
-      } else {
-        break;
-      }
-    */
-    case int8:
-      if (sessionval.(int8) < math.MaxInt8) {
-        return C.float(sessionval.(int8))
-      } else {
-        break;
-      }
-    case int16:
-      if (sessionval.(int16) < math.MaxInt16) {
-        return C.float(sessionval.(int16))
-      } else {
-        break;
-      }
-    case int32:
-      if (sessionval.(int32) < math.MaxInt32) {
-        return C.float(sessionval.(int32))
-      } else {
-        break;
-      }
-    case int64:
-      if (sessionval.(int64) < math.MaxInt64) {
-        return C.float(sessionval.(int64))
-      } else {
-        break;
-      }
-  }
-  return C.float(math.NaN())
-}
-
-/* Export the function to C via CGO with // notation. */
+	fitKept.Lock()
+	if fh := fitKept.fh; fh != nil && fitKept.name == name && fitKept.size == st.Size() && fitKept.mtime.Equal(st.ModTime()) {
+		fitKept.Unlock()
+		if read_lock_fit_handle(fh) {
+			return fh
+		}
+	} else {
+		fitKept.Unlock()
+	}
+	/* Decode outside the lock; it is the slow part. */
+	fh := open_fit_handle(fname, prog, sink)
+	if fh == nil {
+		return nil
+	}
+	/* Locked before it is kept, so it is not closed before it is read. */
+	read_lock_fit_handle(fh)
+	fitKept.Lock()
+	old := fitKept.fh
+	fitKept.name, fitKept.size, fitKept.mtime, fitKept.fh = name, st.Size(), st.ModTime(), fh
+	fitKept.Unlock()
+	if old != nil {
+		/* Waits for any load still reading it. */
+		go close_fit_handle(old)
+	}
+	return fh
+}
+
+/* Let go of the FIT file kept decoded, when another file is to be shown. */
+//export fit_forget_file
+func fit_forget_file() {
+	fitKept.Lock()
+	old := fitKept.fh
+	fitKept.fh = nil
+	fitKept.Unlock()
+	if old != nil {
+		go close_fit_handle(old)
+	}
+}
+
+/* Records are copied out this many at a time. */
+const fitBatchSize = 4096
 
+/* Fill act (initialized by the caller with activity_init) with one session
+ * of a FIT file.  Only that session's records and laps are copied out; the
+ * number of sessions in the file is left in act->nsessions.  The file is
+ * decoded only if it is not the one kept from the last load.  Progress is
+ * reported through prog, which may be NULL, and the load stops early if it
+ * is cancelled.  Records are published through prog as they are copied
+ * out, or for the first session of a file being decoded, as they are
+ * decoded.
+ * Returns 0 on success, 1 on failure.
+ */
 //export parse_fit_file
-func parse_fit_file(fname *C.char, recSize int, lapSize int) (
-  C.long,
-	C.size_t, *C.long,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.long,
-	C.size_t, *C.long,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.size_t, *C.float,
-	C.long,
-	C.long,
-	C.long,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.float,
-	C.long) {
+func parse_fit_file(fname *C.char, session C.long, act *C.ActivityData, prog *C.ActivityProgress) C.long {
+	/* The first session's records lead the file, so while it is decoded
+	 * they can go straight out, into columns with room for the records and
+	 * laps of every session; where the session ends is not known yet.
+	 */
+	streamed := false
+	sink := func(fh *fitHandle, n int) bool {
+		if session != 0 {
+			return true
+		}
+		if !streamed {
+			if C.activity_alloc(act, C.long(fh.recsFound), C.long(fh.lapsFound)) != 0 {
+				return false
+			}
+			streamed = true
+		}
+		from := int(act.nrecs)
+		copy_records(fh, from, n-from, act, from)
+		act.nrecs = C.long(n)
+		/* Let the display start on the records read so far. */
+		C.activity_progress_publish(prog, act.nrecs)
+		return true
+	}
 	/* Open an activity file. */
-	filename := C.GoString(fname)
-	af := open_fit_file(filename)
-  if af != nil {
-    /* Convert the records to arrays (for items that are time based). */
-      pRecTimestamp,
-      pRecDistance,
-      pRecSpeed,
-      pRecAltitude,
-      pRecCadence,
-      pRecHeartRate,
-      pRecLat,
-      pRecLong,
-      nRecs,
-      pLapTimestamp,
-      pLapTotalDistance,
-      pLapStartPositionLat,
-      pLapStartPositionLong,
-      pLapEndPositionLat,
-      pLapEndPositionLong,
-      pLapTotalCalories,
-      pLapTotalElapsedTime,
-      pLapTotalTimerTime,
-      nLaps := make_arrays(af, recSize, lapSize)
-      /* Find the local time zone offset from UTC. */
-      _, tzOffset := af.Activity.LocalTimestamp.Zone()
-      /* Successful read, return values and error = 0. */
-      return 0,  //success!!
-      C.size_t(recSize), (*C.long)(pRecTimestamp),
-      C.size_t(recSize), (*C.float)(pRecDistance),
-      C.size_t(recSize), (*C.float)(pRecSpeed),
-      C.size_t(recSize), (*C.float)(pRecAltitude),
-      C.size_t(recSize), (*C.float)(pRecCadence),
-      C.size_t(recSize), (*C.float)(pRecHeartRate),
-      C.size_t(recSize), (*C.float)(pRecLat),
-      C.size_t(recSize), (*C.float)(pRecLong),
-      C.long(nRecs),
-      C.size_t(lapSize), (*C.long)(pLapTimestamp),
-      C.size_t(lapSize), (*C.float)(pLapTotalDistance),
-      C.size_t(lapSize), (*C.float)(pLapStartPositionLat),
-      C.size_t(lapSize), (*C.float)(pLapStartPositionLong),
-      C.size_t(lapSize), (*C.float)(pLapEndPositionLat),
-      C.size_t(lapSize), (*C.float)(pLapEndPositionLong),
-      C.size_t(lapSize), (*C.float)(pLapTotalCalories),
-      C.size_t(lapSize), (*C.float)(pLapTotalElapsedTime),
-      C.size_t(lapSize), (*C.float)(pLapTotalTimerTime),
-      C.long(nLaps),
-      C.long(af.Sessions[0].Timestamp.Unix()),
-      C.long(af.Sessions[0].StartTime.Unix()),
-      num_cvt(af.Sessions[0].StartPositionLat.Degrees()),
-      num_cvt(af.Sessions[0].StartPositionLong.Degrees()),
-      num_cvt(af.Sessions[0].GetTotalElapsedTimeScaled()),
-      num_cvt(af.Sessions[0].GetTotalTimerTimeScaled()),
-      num_cvt(af.Sessions[0].GetTotalDistanceScaled()),
-      num_cvt(af.Sessions[0].NecLat.Degrees()),
-      num_cvt(af.Sessions[0].NecLong.Degrees()),
-      num_cvt(af.Sessions[0].SwcLat.Degrees()),
-      num_cvt(af.Sessions[0].SwcLong.Degrees()),
-      num_cvt(af.Sessions[0].TotalWork),
-      num_cvt(af.Sessions[0].GetTotalMovingTimeScaled()),
-      num_cvt(af.Sessions[0].GetAvgLapTimeScaled()),
-      num_cvt(af.Sessions[0].TotalCalories),
-      num_cvt(af.Sessions[0].GetAvgSpeedScaled()),
-      num_cvt(af.Sessions[0].GetMaxSpeedScaled()),
-      num_cvt(af.Sessions[0].TotalAscent),
-      num_cvt(af.Sessions[0].TotalDescent),
-      num_cvt(af.Sessions[0].GetAvgAltitudeScaled()),
-      num_cvt(af.Sessions[0].GetMaxAltitudeScaled()),
-      num_cvt(af.Sessions[0].GetMinAltitudeScaled()),
-      num_cvt(af.Sessions[0].AvgHeartRate),
-      num_cvt(af.Sessions[0].MaxHeartRate),
-      num_cvt(af.Sessions[0].MinHeartRate),
-      num_cvt(af.Sessions[0].AvgCadence),
-      num_cvt(af.Sessions[0].MaxCadence),
-      num_cvt(af.Sessions[0].AvgTemperature),
-      num_cvt(af.Sessions[0].MaxTemperature),
-      num_cvt(af.Sessions[0].TotalAnaerobicTrainingEffect),
-      C.long(tzOffset)
-
-  } else {
-      /* Failed read.  Return garbage values and error = 1. */
-      return 1,  //failed!
-      C.size_t(recSize), (*C.long)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.size_t(recSize), (*C.float)(nil),
-      C.long(0),
-      C.size_t(lapSize), (*C.long)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.size_t(lapSize), (*C.float)(nil),
-      C.long(0),
-      C.long(0),
-      C.long(0),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.float(math.NaN()),
-      C.long(0)
-  }
-
+	fh := kept_fit_handle(fname, prog, sink)
+	if fh == nil {
+		/* Failed read. */
+		return 1
+	}
+	defer fh.mu.RUnlock()
+	act.nsessions = C.long(len(fh.spans))
+	if session < 0 || int(session) >= len(fh.spans) {
+		return 1
+	}
+	act.session = session
+	sp := fh.spans[session]
+	nRecs := sp.recEnd - sp.recStart
+	nLaps := sp.lapEnd - sp.lapStart
+	if streamed {
+		/* Any records past the end of the session were shown while it was
+		 * decoded, but are not part of it.
+		 */
+		if nLaps > fh.lapsFound {
+			return 1
+		}
+		act.nrecs = C.long(nRecs)
+	} else if C.activity_alloc(act, C.long(nRecs), C.long(nLaps)) != 0 {
+		/* Size each column to exactly what the session holds. */
+		return 1
+	}
+	/* Copy the records out a batch at a time. */
+	for int(act.nrecs) < nRecs {
+		if C.activity_progress_cancelled(prog) != 0 {
+			return 1
+		}
+		n := nRecs - int(act.nrecs)
+		if n > fitBatchSize {
+			n = fitBatchSize
+		}
+		copy_records(fh, sp.recStart+int(act.nrecs), n, act, int(act.nrecs))
+		act.nrecs += C.long(n)
+		/* Let the display start on the records read so far. */
+		C.activity_progress_publish(prog, act.nrecs)
+	}
+	act.nlaps = copy_laps(fh, sp, act)
+	copy_session(fh, int(session), act)
+	/* Successful read. */
+	return 0
 }
 
 /* Dummy function (required for cgo) */
@@ -1,5 +1,3 @@
 module github.com/cprevallet/fitwrapper
 
-go 1.15
-
-require github.com/tormoder/fit v0.10.0
+go 1.17
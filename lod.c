@@ -0,0 +1,221 @@
+#include <stdlib.h>
+
+#include "lod.h"
+
+/* Build the pyramid for n samples of x and y.  Returns NULL if x is not in
+ * order (lod_decimate bisects it) or memory could not be had, in which case
+ * the series is simply drawn in full.
+ */
+LodPyramid *
+lod_build (const PLFLT *x, const PLFLT *y, long n)
+{
+  LodPyramid *lod = (LodPyramid *)calloc (1, sizeof (LodPyramid));
+  if (lod == NULL)
+    return NULL;
+  return lod_extend (lod, x, y, n);
+}
+
+/* Extend the pyramid to the first n samples of x and y, n being no fewer
+ * than it was built for.  Only the buckets holding the new samples are
+ * merged again.  As lod_build, returns NULL (having freed lod) if the new
+ * samples put x out of order or memory could not be had.
+ */
+LodPyramid *
+lod_extend (LodPyramid *lod, const PLFLT *x, const PLFLT *y, long n)
+{
+  if (lod == NULL)
+    return NULL;
+  /* Written this way round so that a NaN counts as out of order too. */
+  for (long i = lod->n > 1 ? lod->n : 1; i < n; i++)
+    if (!(x[i] >= x[i - 1]))
+      {
+        lod_free (lod);
+        return NULL;
+      }
+  /* Halve until a single bucket covers the series. */
+  int nlevels = 0;
+  for (long nb = n; nb > 1; nb = (nb + 1) / 2)
+    nlevels++;
+  if (nlevels > lod->nlevels)
+    {
+      LodLevel *level
+          = (LodLevel *)realloc (lod->level, nlevels * sizeof (LodLevel));
+      if (level == NULL)
+        {
+          lod_free (lod);
+          return NULL;
+        }
+      for (int k = lod->nlevels; k < nlevels; k++)
+        {
+          level[k].nbuckets = level[k].cap = 0;
+          level[k].imin = level[k].imax = NULL;
+        }
+      lod->level = level;
+      lod->nlevels = nlevels;
+    }
+
+  long nchild = n;
+  long dirty = lod->n; // the first child whose bucket must be merged again
+  for (int k = 0; k < lod->nlevels; k++)
+    {
+      LodLevel *lv = &lod->level[k];
+      long nbuckets = (nchild + 1) / 2;
+      if (nbuckets > lv->cap)
+        {
+          /* Grow geometrically, so a series extended a little at a time
+           * is not copied over and over.
+           */
+          long cap = 2 * lv->cap > nbuckets ? 2 * lv->cap : nbuckets;
+          long *imin = (long *)realloc (lv->imin, cap * sizeof (long));
+          if (imin != NULL)
+            lv->imin = imin;
+          long *imax = (long *)realloc (lv->imax, cap * sizeof (long));
+          if (imax != NULL)
+            lv->imax = imax;
+          if (imin == NULL || imax == NULL)
+            {
+              lod_free (lod);
+              return NULL;
+            }
+          lv->cap = cap;
+        }
+      lv->nbuckets = nbuckets;
+      /* Each bucket merges two from the level below (or two samples). */
+      const LodLevel *below = k > 0 ? &lod->level[k - 1] : NULL;
+      for (long b = dirty / 2; b < nbuckets; b++)
+        {
+          long l = 2 * b;
+          long r = 2 * b + 1 < nchild ? 2 * b + 1 : l;
+          long lmin = below ? below->imin[l] : l;
+          long lmax = below ? below->imax[l] : l;
+          long rmin = below ? below->imin[r] : r;
+          long rmax = below ? below->imax[r] : r;
+          lv->imin[b] = y[rmin] < y[lmin] ? rmin : lmin;
+          lv->imax[b] = y[rmax] > y[lmax] ? rmax : lmax;
+        }
+      dirty /= 2;
+      nchild = nbuckets;
+    }
+  lod->n = n;
+  return lod;
+}
+
+void
+lod_free (LodPyramid *lod)
+{
+  if (lod == NULL)
+    return;
+  for (int k = 0; k < lod->nlevels; k++)
+    {
+      free (lod->level[k].imin);
+      free (lod->level[k].imax);
+    }
+  free (lod->level);
+  free (lod);
+}
+
+/* Index of the first sample with x >= v (or x > v if after is set), by
+ * bisection.  lod_build has checked that x never decreases.
+ */
+static long
+bisect (const PLFLT *x, long n, PLFLT v, int after)
+{
+  long lo = 0, hi = n;
+  while (lo < hi)
+    {
+      long mid = lo + (hi - lo) / 2;
+      if (x[mid] < v || (after && x[mid] == v))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Reduce the samples between xmin and xmax to about two points per pixel
+ * column, writing them to outx and outy (room for LOD_POINTS (columns)
+ * each).  Returns the number of points written.
+ */
+long
+lod_decimate (const LodPyramid *lod, const PLFLT *x, const PLFLT *y,
+              PLFLT xmin, PLFLT xmax, long columns, PLFLT *outx, PLFLT *outy)
+{
+  long n = lod->n;
+  long out = 0;
+  if (n <= 0)
+    return 0;
+  if (columns < 1)
+    columns = 1;
+  /* The samples in view, [v0, v1), and one either side so the line
+   * reaches the edges of the plot, [i0, i1).
+   */
+  long v0 = bisect (x, n, xmin, 0);
+  long v1 = bisect (x, n, xmax, 1);
+  long i0 = v0 > 0 ? v0 - 1 : 0;
+  long i1 = v1 < n ? v1 + 1 : n;
+  long m = i1 - i0;
+  if (m <= 0)
+    return 0;
+
+  /* Few enough to draw as they are. */
+  if (m <= 2 * columns)
+    {
+      for (long i = i0; i < i1; i++)
+        {
+          outx[out] = x[i];
+          outy[out++] = y[i];
+        }
+      return out;
+    }
+
+  /* The finest level with no more than about one bucket per column. */
+  int k = 0;
+  while (k < lod->nlevels - 1 && (m >> (k + 1)) > columns)
+    k++;
+  const LodLevel *lv = &lod->level[k];
+  int shift = k + 1;
+  if (i0 < v0)
+    {
+      outx[out] = x[i0];
+      outy[out++] = y[i0];
+    }
+  for (long b = v0 >> shift; b <= (v1 - 1) >> shift; b++)
+    {
+      long lo = b << shift;
+      long hi = (b + 1) << shift;
+      long imin = lv->imin[b];
+      long imax = lv->imax[b];
+      /* The extremes of a bucket the view cuts through may be out of view
+       * and hide those in it, so that part is searched instead.
+       */
+      if (lo < v0 || hi > v1)
+        {
+          lo = lo > v0 ? lo : v0;
+          hi = hi < v1 ? hi : v1;
+          imin = imax = lo;
+          for (long i = lo + 1; i < hi; i++)
+            {
+              if (y[i] < y[imin])
+                imin = i;
+              if (y[i] > y[imax])
+                imax = i;
+            }
+        }
+      /* Both extremes, in the order they were recorded. */
+      long first = imin < imax ? imin : imax;
+      long second = imin < imax ? imax : imin;
+      outx[out] = x[first];
+      outy[out++] = y[first];
+      if (second != first)
+        {
+          outx[out] = x[second];
+          outy[out++] = y[second];
+        }
+    }
+  if (i1 > v1)
+    {
+      outx[out] = x[i1 - 1];
+      outy[out++] = y[i1 - 1];
+    }
+  return out;
+}
@@ -0,0 +1,47 @@
+#ifndef LOD_H_
+#define LOD_H_
+
+/*
+ * Level-of-detail reduction for plotted series, so that drawing a plot costs
+ * about the same whatever the number of samples behind it.
+ *
+ * A pyramid is built once per series.  Each level splits the samples into
+ * buckets twice the size of the level below and keeps, per bucket, the
+ * indices of its lowest and highest y.  To draw a range of x, the level whose
+ * buckets are about one pixel column wide is picked and each bucket
+ * contributes its minimum and maximum in sample order, so spikes survive
+ * the reduction.  A series that grows is extended in place, redoing only the
+ * buckets the new samples fall in.  Finding the range by bisection needs x
+ * in order, so a series whose x ever decreases gets no pyramid and is drawn
+ * in full.
+ */
+
+#include <plplot.h>
+
+typedef struct LodLevel
+{
+  long nbuckets;
+  long cap;   // room in imin and imax
+  long *imin; // per bucket, index of the sample with the lowest y
+  long *imax; // and of the one with the highest
+} LodLevel;
+
+typedef struct LodPyramid
+{
+  long n;          // samples in the series
+  int nlevels;
+  LodLevel *level; // level[k] has buckets of 2^(k+1) samples
+} LodPyramid;
+
+/* Room lod_decimate needs for a plot this many pixel columns wide. */
+#define LOD_POINTS(columns) (2 * (columns) + 6)
+
+LodPyramid *lod_build (const PLFLT *x, const PLFLT *y, long n);
+LodPyramid *lod_extend (LodPyramid *lod, const PLFLT *x, const PLFLT *y,
+                        long n);
+void lod_free (LodPyramid *lod);
+long lod_decimate (const LodPyramid *lod, const PLFLT *x, const PLFLT *y,
+                   PLFLT xmin, PLFLT xmax, long columns, PLFLT *outx,
+                   PLFLT *outy);
+
+#endif /* !LOD_H_ */
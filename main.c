@@ -29,7 +29,6 @@
  *  libplplot.so.17
  *	libcairo.so.2
  *  libosmgpsmap-1.0
- *  librsvg-2.0
  */
 
 /* Utilities */
@@ -46,11 +45,6 @@
 #include <gdk/gdk.h>
 #include <glib.h>
 #include <gtk/gtk.h>
-/*
- * Rsvglib
- */
-#include <librsvg/rsvg.h>
-
 /*
  * PLPlot
  */
@@ -66,8 +60,12 @@
 /*
  * Fit file decoding - fitwrapper.h automatically generated by make/cgo.
  */
+#include "activity.h"
+#include "cache.h"
 #include "fitwrapper.h"
+#include "lod.h"
 #include "tcxwrapper.h"
+#include <libxml/parser.h>
 
 //
 // Declarations section
@@ -75,12 +73,6 @@
 #define VERSION "1.9"
 // How big should the initial window be?
 #define FRACT_OF_SCRN 0.85
-// Maximum readable records from a fit file.
-// 2880 is large enough for 4 hour marathon at 5 sec intervals
-//#define NSIZE 2880
-#define NSIZE 16000
-// Maximum readable laps from a fit file.
-#define LSIZE 400
 /* Define the amount of "margin" space on the graph as a normalized (0 - 1)
  * value of the plot width and height. In reality, the margin includes
  * labels, and titles in addition to blank space.
@@ -89,10 +81,21 @@
 #define NORMYMIN 0.1
 #define NORMXMAX 0.9
 #define NORMYMAX 0.9
+/* The plot is drawn on a page of this size (in points) and scaled to fit the
+ * drawing area, keeping its 4:3 shape.  get_graph_edges relies on that shape.
+ */
+#define PAGE_WIDTH 720
+#define PAGE_HEIGHT 540
+/* While the view is being dragged the plot is drawn in draft: with this
+ * fraction of the points, and bare axes.  The full plot replaces it once
+ * input has stopped for GESTURE_SETTLE_MS.
+ */
+#define DRAFT_DECIMATION 4
+#define GESTURE_SETTLE_MS 150
+/* How long a zoom takes to move the view to its target. */
+#define VIEW_ANIMATION_MS 150
 /* The linewidth of the individual tracks. */
 #define TRACKWIDTH 9.0 
-// the result structure defined by fitwrapper.h
-struct parse_fit_file_return result;
 
 enum ZoomState
 {
@@ -114,6 +117,30 @@ enum PlotType
   LapPlot = 5
 };
 
+/* A column of display values that several plots may share.  It is released
+ * when the last plot holding a reference lets go of it, and grows in place
+ * while a file is still loading.
+ */
+typedef struct SharedColumn
+{
+  int refs;
+  int len;
+  int cap;   // room in v
+  PLFLT min; // extents of v, kept up as values are added
+  PLFLT max;
+  PLFLT *v;
+} SharedColumn;
+
+/* The record-based columns common to every plot along the distance axis, in
+ * the current unit system.
+ */
+typedef struct PlotColumns
+{
+  SharedColumn *x; // distance
+  SharedColumn *lat;
+  SharedColumn *lng;
+} PlotColumns;
+
 /* The main data structure for the program defining
  * values for various aspects of displaying a plot
  * including the actual x,y pairs, axis labels,
@@ -142,12 +169,18 @@ typedef struct PlotData
   PLFLT vw_pymax;
   PLFLT *lat; // activity location, degrees lat,lng
   PLFLT *lng;
+  SharedColumn *xcol; // storage behind x, lat and lng, possibly shared
+  SharedColumn *latcol;
+  SharedColumn *lngcol;
+  LodPyramid *lod;  // min/max levels of y, for drawing at screen resolution
   char *start_time; // activity start time
   char *symbol;     // plot symbol character
   char *xaxislabel; // axis labels
   char *yaxislabel;
   int linecolor[3]; // rgb attributes
   enum UnitSystem units;
+  gboolean stale; // display values need re-deriving from the raw values
+  guint generation; // changes whenever the display values are re-derived
 } PlotData;
 
 /* Similar to above but for an entire workout
@@ -191,8 +224,10 @@ typedef struct SessionData
 /* The data structures for the data plots.  There is one for each
  * type of plot and an additional pointer, pd, that is assigned
  * from one of the other four depending on what the user is currently
- * displaying.  Finally, there is another pointer for the overall
- * session data displayed by the summary.
+ * displaying.  There is another pointer for the overall
+ * session data displayed by the summary.  Finally, the raw values
+ * everything above is derived from are kept so that the display can be
+ * re-derived (e.g. in other units) without reading the file again.
  */
 typedef struct AllData
 {
@@ -203,6 +238,8 @@ typedef struct AllData
   struct PlotData *plap;
   struct PlotData *pd;
   struct SessionData *psd;
+  ActivityData *pact; // raw (SI unit) values for the loaded session
+  PlotColumns *pcols; // display columns shared by the plots
 } AllData;
 
 /* Declarations for the GUI widgets. */
@@ -218,6 +255,9 @@ GtkFrame *viewport;
 GtkFrame *frame_Summary;
 GtkButton *btn_Zoom_In, *btn_Zoom_Out, *btn_About;
 GtkComboBoxText *cb_Units;
+GtkComboBoxText *cb_Session;
+GtkProgressBar *pb_Load;
+GtkButton *btn_Cancel;
 GtkScale *sc_IdxPct;
 GtkLabel *lbl_val;
 GtkPaned *pane_Content;
@@ -225,6 +265,9 @@ GtkWindow *window;
 
 /* Declaration for the fit filename. */
 char *fname = NULL;
+/* Which of the file's sessions is displayed, and how many there are. */
+long session_index = 0;
+long num_sessions = 0;
 
 /* Declarations for OsmGps maps.
  * Since these are updated by the slider, we'll make them
@@ -550,226 +593,395 @@ reset_zoom (PlotData *pd)
  *  on the selected unit system and local time zone.
  */
 void
-raw_to_user_session (
-    SessionData *psd, time_t sess_timestamp, time_t sess_start_time,
-    float sess_start_position_lat, float sess_start_position_long,
-    float sess_total_elapsed_time, float sess_total_timer_time,
-    float sess_total_distance, float sess_nec_lat, float sess_nec_long,
-    float sess_swc_lat, float sess_swc_long, float sess_total_work,
-    float sess_total_moving_time, float sess_avg_lap_time,
-    float sess_total_calories, float sess_avg_speed, float sess_max_speed,
-    float sess_total_ascent, float sess_total_descent, float sess_avg_altitude,
-    float sess_max_altitude, float sess_min_altitude, float sess_max_heart_rate,
-    float sess_avg_heart_rate, float sess_max_cadence, float sess_avg_cadence,
-    float sess_avg_temperature, float sess_max_temperature,
-    float sess_min_heart_rate, float sess_total_anaerobic_training_effect,
-    time_t tz_offset)
+raw_to_user_session (SessionData *psd, ActivityData *act)
 {
+  ActivitySession *sess = &act->sess;
   /* Correct the start and end times to local time. */
-  time_t l_time = sess_start_time + tz_offset;
+  time_t l_time = sess->start_time + act->time_zone_offset;
+  free (psd->start_time);
   psd->start_time = strdup (asctime (gmtime (&l_time)));
-  l_time = sess_timestamp + tz_offset;
+  l_time = sess->timestamp + act->time_zone_offset;
+  free (psd->timestamp);
   psd->timestamp = strdup (asctime (gmtime (&l_time)));
-  psd->start_position_lat = sess_start_position_lat;
-  psd->start_position_long = sess_start_position_long;
-  psd->total_elapsed_time = sess_total_elapsed_time;
-  psd->total_timer_time = sess_total_timer_time;
+  psd->start_position_lat = sess->start_position_lat;
+  psd->start_position_long = sess->start_position_long;
+  psd->total_elapsed_time = sess->total_elapsed_time;
+  psd->total_timer_time = sess->total_timer_time;
   if (psd->units == English)
     {
       psd->total_distance
-          = sess_total_distance * 0.00062137119; // meters to miles
+          = sess->total_distance * 0.00062137119; // meters to miles
     }
   else
     {
-      psd->total_distance = sess_total_distance * 0.001; // meters to kilometers
+      psd->total_distance = sess->total_distance * 0.001; // meters to kilometers
     }
-  psd->nec_lat = sess_nec_lat;
-  psd->nec_long = sess_nec_long;
-  psd->swc_lat = sess_swc_lat;
-  psd->swc_long = sess_swc_long;
-  psd->total_work = sess_total_work / 1000.0; // J to kJ
+  psd->nec_lat = sess->nec_latitude;
+  psd->nec_long = sess->nec_longitude;
+  psd->swc_lat = sess->swc_latitude;
+  psd->swc_long = sess->swc_longitude;
+  psd->total_work = sess->total_work / 1000.0; // J to kJ
 
-  psd->total_moving_time = sess_total_moving_time;
-  psd->avg_lap_time = sess_avg_lap_time;
-  psd->total_calories = sess_total_calories;
+  psd->total_moving_time = sess->total_moving_time;
+  psd->avg_lap_time = sess->average_lap_time;
+  psd->total_calories = sess->total_calories;
 
   if (psd->units == English)
     {
-      psd->avg_speed = sess_avg_speed * 2.2369363; // meters/s to miles/hr
-      psd->max_speed = sess_max_speed * 2.2369363; // meters/s to miles/hr
+      psd->avg_speed = sess->avg_speed * 2.2369363; // meters/s to miles/hr
+      psd->max_speed = sess->max_speed * 2.2369363; // meters/s to miles/hr
     }
   else
     {
-      psd->avg_speed = sess_avg_speed * 3.6; // meters/s to kilometers/hr
-      psd->max_speed = sess_max_speed * 3.6; // meters/s to kilometers/hr
+      psd->avg_speed = sess->avg_speed * 3.6; // meters/s to kilometers/hr
+      psd->max_speed = sess->max_speed * 3.6; // meters/s to kilometers/hr
     }
 
   if (psd->units == English)
     {
-      psd->total_ascent = sess_total_ascent * 3.2808399;   // meters to feet
-      psd->total_descent = sess_total_descent * 3.2808399; // meters to feet
-      psd->avg_altitude = sess_avg_altitude * 3.2808399;   // meters to feet
-      psd->max_altitude = sess_max_altitude * 3.2808399;   // meters to feet
-      psd->min_altitude = sess_min_altitude * 3.2808399;   // meters to feet
+      psd->total_ascent = sess->total_ascent * 3.2808399;   // meters to feet
+      psd->total_descent = sess->total_descent * 3.2808399; // meters to feet
+      psd->avg_altitude = sess->avg_altitude * 3.2808399;   // meters to feet
+      psd->max_altitude = sess->max_altitude * 3.2808399;   // meters to feet
+      psd->min_altitude = sess->min_altitude * 3.2808399;   // meters to feet
     }
   else
     {
-      psd->total_ascent = sess_total_ascent * 1.0;   // meters to meters
-      psd->total_descent = sess_total_descent * 1.0; // meters to meters
-      psd->avg_altitude = sess_avg_altitude * 1.0;   // meters to meters
-      psd->max_altitude = sess_max_altitude * 1.0;   // meters to meters
-      psd->min_altitude = sess_min_altitude * 1.0;   // meters to meters
+      psd->total_ascent = sess->total_ascent * 1.0;   // meters to meters
+      psd->total_descent = sess->total_descent * 1.0; // meters to meters
+      psd->avg_altitude = sess->avg_altitude * 1.0;   // meters to meters
+      psd->max_altitude = sess->max_altitude * 1.0;   // meters to meters
+      psd->min_altitude = sess->min_altitude * 1.0;   // meters to meters
     }
 
-  psd->max_heart_rate = sess_max_heart_rate;
-  psd->avg_heart_rate = sess_avg_heart_rate;
-  psd->max_cadence = sess_max_cadence;
-  psd->avg_cadence = sess_avg_cadence;
+  psd->max_heart_rate = sess->max_heartrate;
+  psd->avg_heart_rate = sess->avg_heartrate;
+  psd->max_cadence = sess->max_cadence;
+  psd->avg_cadence = sess->avg_cadence;
 
   if (psd->units == English)
     {
-      psd->avg_temperature = 1.8 * sess_avg_temperature + 32.0;
-      psd->max_temperature = 1.8 * sess_max_temperature + 32.0;
+      psd->avg_temperature = 1.8 * sess->avg_temperature + 32.0;
+      psd->max_temperature = 1.8 * sess->max_temperature + 32.0;
     }
   else
     {
-      psd->avg_temperature = sess_avg_temperature * 1.0;
-      psd->max_temperature = sess_max_temperature * 1.0;
+      psd->avg_temperature = sess->avg_temperature * 1.0;
+      psd->max_temperature = sess->max_temperature * 1.0;
     }
 
-  psd->min_heart_rate = sess_min_heart_rate;
-  psd->total_anaerobic_training_effect = sess_total_anaerobic_training_effect;
+  psd->min_heart_rate = sess->min_heartrate;
+  psd->total_anaerobic_training_effect = sess->total_anaerobic_training_effect;
 }
 
-/*  This routine is where the bulk of the plot initialization
- *  occurs.
- *
- *  We take the raw values from the fit file conversion
- *  routines and convert them to display-appropriate values based
- *  on:
- *  1. the selected unit system
- *  2. the local time zone
- *
- *  as well as setting labels and range limits to initial values.
- *
+/* Create a column of len values, holding one reference.  Returns NULL if
+ * memory could not be had.
+ */
+SharedColumn *
+column_new (int len)
+{
+  SharedColumn *col = (SharedColumn *)malloc (sizeof (SharedColumn));
+  if (col == NULL)
+    return NULL;
+  col->cap = len > 0 ? len : 1;
+  col->v = (PLFLT *)malloc (col->cap * sizeof (PLFLT));
+  if (col->v == NULL)
+    {
+      free (col);
+      return NULL;
+    }
+  col->refs = 1;
+  col->len = len;
+  col->min = FLT_MAX;
+  col->max = -FLT_MAX;
+  return col;
+}
+
+/* Convert raw[from, to) into v, taking in their extents. */
+static void
+column_fill (SharedColumn *col, float *raw, int from, int to, PLFLT cnv)
+{
+  for (int i = from; i < to; i++)
+    {
+      col->v[i] = (PLFLT)raw[i] * cnv;
+      if (col->v[i] < col->min)
+        col->min = col->v[i];
+      if (col->v[i] > col->max)
+        col->max = col->v[i];
+    }
+}
+
+/* Fill a new column from raw values times a conversion factor.  Returns
+ * NULL if memory could not be had.
+ */
+SharedColumn *
+column_from_raw (float *raw, int len, PLFLT cnv)
+{
+  SharedColumn *col = column_new (len);
+  if (col == NULL)
+    return NULL;
+  column_fill (col, raw, 0, len, cnv);
+  return col;
+}
+
+/* Add the raw values past the end of a column, up to len, times the same
+ * conversion factor it was filled with.  v may move; whoever points into it
+ * must look again.  Returns 0 on success, 1 if memory could not be had
+ * (leaving the column as it was).
  */
+int
+column_append (SharedColumn *col, float *raw, int len, PLFLT cnv)
+{
+  if (col == NULL)
+    return 1;
+  if (len > col->cap)
+    {
+      /* Grow geometrically, so a run read a batch at a time is not copied
+       * over and over.
+       */
+      int cap = 2 * col->cap > len ? 2 * col->cap : len;
+      PLFLT *v = (PLFLT *)realloc (col->v, cap * sizeof (PLFLT));
+      if (v == NULL)
+        return 1;
+      col->v = v;
+      col->cap = cap;
+    }
+  column_fill (col, raw, col->len, len, cnv);
+  if (len > col->len)
+    col->len = len;
+  return 0;
+}
+
+SharedColumn *
+column_ref (SharedColumn *col)
+{
+  if (col != NULL)
+    col->refs++;
+  return col;
+}
+
 void
-raw_to_user_plots (PlotData *pdest, int num_recs, float x_raw[NSIZE],
-                   float y_raw[NSIZE], float lat_raw[NSIZE],
-                   float lng_raw[NSIZE], time_t sess_start_time,
-                   time_t tz_offset)
+column_unref (SharedColumn *col)
+{
+  if ((col != NULL) && (--col->refs == 0))
+    {
+      free (col->v);
+      free (col);
+    }
+}
+
+/* Distance conversion for the unit system. */
+PLFLT
+distance_factor (enum UnitSystem units)
+{
+  if (units == English)
+    return 0.00062137119; // meters to miles
+  else
+    return 0.001; // meters to kilometers
+}
+
+/* (Re)build the record columns every distance-based plot shares.  Plots
+ * still holding the previous columns keep them alive until they are
+ * converted again.
+ * Returns 0 on success, 1 if memory could not be had (leaving no columns).
+ */
+int
+build_plot_columns (PlotColumns *cols, ActivityData *act,
+                    enum UnitSystem units)
+{
+  column_unref (cols->x);
+  column_unref (cols->lat);
+  column_unref (cols->lng);
+  cols->x = column_from_raw (act->rec_distance, act->nrecs,
+                             distance_factor (units));
+  cols->lat = column_from_raw (act->rec_lat, act->nrecs, 1.0);
+  cols->lng = column_from_raw (act->rec_long, act->nrecs, 1.0);
+  if (cols->x == NULL || cols->lat == NULL || cols->lng == NULL)
+    {
+      column_unref (cols->x);
+      column_unref (cols->lat);
+      column_unref (cols->lng);
+      cols->x = cols->lat = cols->lng = NULL;
+      return 1;
+    }
+  return 0;
+}
+
+/* Add the records read since the shared columns were last built or
+ * extended.  Returns 0 on success, 1 if memory could not be had (the
+ * columns may then differ in length until the next try).
+ */
+int
+extend_plot_columns (PlotColumns *cols, ActivityData *act,
+                     enum UnitSystem units)
+{
+  int failed = column_append (cols->x, act->rec_distance, act->nrecs,
+                              distance_factor (units));
+  failed |= column_append (cols->lat, act->rec_lat, act->nrecs, 1.0);
+  failed |= column_append (cols->lng, act->rec_long, act->nrecs, 1.0);
+  return failed;
+}
+
+/* Anything rendered from a plot's earlier values is out of date once the
+ * plot takes this.
+ */
+static guint
+next_plot_generation (void)
+{
+  static guint generation = 0;
+  return ++generation;
+}
+
+/* The raw values behind a plot's y, and the factor that converts them to
+ * the displayed values, by plot type.
+ */
+float *
+plot_y_raw (PlotData *pdest, ActivityData *act, float *cnv)
 {
-  float x_cnv = 1.0;
+  float *y_raw = NULL;
   float y_cnv = 1.0;
-  /* Housekeeping. Release any memory previously allocated before
-   * reinitializing.
-   */
-  if (pdest->x != NULL)
-    free (pdest->x);
-  if (pdest->y != NULL)
-    free (pdest->y);
-  if (pdest->lat != NULL)
-    free (pdest->lat);
-  if (pdest->lng != NULL)
-    free (pdest->lng);
-  /* How big are we? */
-  pdest->num_pts = num_recs;
-  /* Allocate new memory for the converted values. */
-  pdest->lat = (PLFLT *)malloc (pdest->num_pts * sizeof (PLFLT));
-  pdest->lng = (PLFLT *)malloc (pdest->num_pts * sizeof (PLFLT));
-  pdest->x = (PLFLT *)malloc (pdest->num_pts * sizeof (PLFLT));
-  pdest->y = (PLFLT *)malloc (pdest->num_pts * sizeof (PLFLT));
-  /* Assign the conversion factors by plot type. */
   switch (pdest->ptype)
     {
     case PacePlot:
+      y_raw = act->rec_speed;
       if (pdest->units == English)
         {
-          x_cnv = 0.00062137119; // meters to miles
-          y_cnv = 0.037282272;   // meters per sec to miles per min
+          y_cnv = 0.037282272; // meters per sec to miles per min
         }
       else
         {
-          x_cnv = 0.001; // meters to kilometers
-          y_cnv = 0.06;  // meters per sec to kilometers per min
+          y_cnv = 0.06; // meters per sec to kilometers per min
         }
       break;
     case CadencePlot:
-      if (pdest->units == English)
-        {
-          x_cnv = 0.00062137119; // meters to miles
-          y_cnv = 1.0;           // steps to steps
-        }
-      else
-        {
-          x_cnv = 0.001; // meters to kilometers
-          y_cnv = 1.0;   // steps to steps
-        }
+      y_raw = act->rec_cadence;
+      y_cnv = 1.0; // steps to steps
       break;
     case HeartRatePlot:
-      if (pdest->units == English)
-        {
-          x_cnv = 0.00062137119; // meters to miles
-          y_cnv = 1.0;           // bpm to bpm
-        }
-      else
-        {
-          x_cnv = 0.001; // meters to kilometers
-          y_cnv = 1.0;   // bpm to bpm
-        }
+      y_raw = act->rec_heartrate;
+      y_cnv = 1.0; // bpm to bpm
       break;
     case AltitudePlot:
+      y_raw = act->rec_altitude;
       if (pdest->units == English)
         {
-          x_cnv = 0.00062137119; // meters to miles
-          y_cnv = 3.28084;       // meters to feet
+          y_cnv = 3.28084; // meters to feet
         }
       else
         {
-          x_cnv = 0.001; // meters to kilometers
-          y_cnv = 1.0;   // meters to meters
+          y_cnv = 1.0; // meters to meters
         }
       break;
     case LapPlot:
-      if (pdest->units == English)
-        {
-          x_cnv = 0.00062137119; // meters to miles
-          y_cnv = 1.0 / 60.0;    // seconds/lap to minutes/lap
-        }
-      else
-        {
-          x_cnv = 0.001;      // meters to kilometers
-          y_cnv = 1.0 / 60.0; // seconds/lap to minutes/lap
-        }
+      y_raw = act->lap_total_elapsed_time;
+      y_cnv = 1.0 / 60.0; // seconds/lap to minutes/lap
+    }
+  *cnv = y_cnv;
+  return y_raw;
+}
+
+/*  This routine is where the bulk of the plot initialization
+ *  occurs.
+ *
+ *  We take the raw values from the fit file conversion
+ *  routines and convert them to display-appropriate values based
+ *  on:
+ *  1. the selected unit system
+ *  2. the local time zone
+ *
+ *  as well as setting labels and range limits to initial values.
+ *
+ *  Distance and position come from the shared columns in cols (or, for the
+ *  splits, from the lap table); only the y values belong to the plot alone.
+ *
+ *  Returns 0 on success, 1 if memory could not be had, in which case the
+ *  plot is left empty.
+ */
+int
+raw_to_user_plots (PlotData *pdest, ActivityData *act, PlotColumns *cols)
+{
+  float y_cnv = 1.0;
+  float *y_raw = NULL;
+  /* Housekeeping. Release any memory previously allocated before
+   * reinitializing.
+   */
+  column_unref (pdest->xcol);
+  column_unref (pdest->latcol);
+  column_unref (pdest->lngcol);
+  free (pdest->y);
+  pdest->y = NULL;
+  /* The splits plot draws from the lap table rather than the records. */
+  if (pdest->ptype == LapPlot)
+    {
+      pdest->xcol = column_from_raw (act->lap_total_distance, act->nlaps,
+                                     distance_factor (pdest->units));
+      pdest->latcol
+          = column_from_raw (act->lap_start_position_lat, act->nlaps, 1.0);
+      pdest->lngcol
+          = column_from_raw (act->lap_start_position_long, act->nlaps, 1.0);
+    }
+  else
+    {
+      pdest->xcol = column_ref (cols->x);
+      pdest->latcol = column_ref (cols->lat);
+      pdest->lngcol = column_ref (cols->lng);
     }
-  /* Convert (or in the case of positions/time, copy) the raw values to the
-   * displayed values.
+  /* Allocate new memory for the converted values, with room for as many
+   * as the columns have (see extend_user_plot).
    */
-  for (int i = 0; i < pdest->num_pts; i++)
+  if (pdest->xcol != NULL)
+    pdest->y = (PLFLT *)malloc (pdest->xcol->cap * sizeof (PLFLT));
+  if (pdest->xcol == NULL || pdest->latcol == NULL || pdest->lngcol == NULL
+      || pdest->y == NULL)
     {
-      pdest->x[i] = (PLFLT)x_raw[i] * x_cnv;
-      pdest->y[i] = (PLFLT)y_raw[i] * y_cnv;
+      /* Leave the plot empty rather than half made. */
+      column_unref (pdest->xcol);
+      column_unref (pdest->latcol);
+      column_unref (pdest->lngcol);
+      free (pdest->y);
+      lod_free (pdest->lod);
+      pdest->xcol = pdest->latcol = pdest->lngcol = NULL;
+      pdest->x = pdest->y = pdest->lat = pdest->lng = NULL;
+      pdest->lod = NULL;
+      pdest->num_pts = 0;
+      pdest->generation = next_plot_generation ();
+      return 1;
     }
+  pdest->x = pdest->xcol->v;
+  pdest->lat = pdest->latcol->v;
+  pdest->lng = pdest->lngcol->v;
+  /* How big are we? */
+  pdest->num_pts = pdest->xcol->len;
+  /* Assign the conversion factors by plot type. */
+  y_raw = plot_y_raw (pdest, act, &y_cnv);
+  /* Convert the raw values to the displayed values. */
   for (int i = 0; i < pdest->num_pts; i++)
     {
-      pdest->lat[i] = (PLFLT)lat_raw[i];
-      pdest->lng[i] = (PLFLT)lng_raw[i];
+      pdest->y[i] = (PLFLT)y_raw[i] * y_cnv;
     }
   /* Set start time in local time (for title) */
-  time_t l_time = sess_start_time + tz_offset;
+  time_t l_time = act->sess.start_time + act->time_zone_offset;
+  free (pdest->start_time);
   pdest->start_time = strdup (asctime (gmtime (&l_time)));
 
-  /* Find plot data min, max */
-  pdest->xmin = FLT_MAX;
-  pdest->xmax = -FLT_MAX;
+  /* Anything rendered from the previous values is now out of date. */
+  pdest->generation = next_plot_generation ();
+
+  /* Distance-based plots are drawn from a level-of-detail pyramid, when
+   * their distances are in order.
+   */
+  lod_free (pdest->lod);
+  pdest->lod = NULL;
+  if (pdest->ptype != LapPlot)
+    pdest->lod = lod_build (pdest->x, pdest->y, pdest->num_pts);
+
+  /* Find plot data min, max.  The distance extents come with the column. */
+  pdest->xmin = pdest->xcol->min;
+  pdest->xmax = pdest->xcol->max;
   pdest->ymin = FLT_MAX;
   pdest->ymax = -FLT_MAX;
   for (int i = 0; i < pdest->num_pts; i++)
     {
-      if (pdest->x[i] < pdest->xmin)
-        pdest->xmin = pdest->x[i];
-      if (pdest->x[i] > pdest->xmax)
-        pdest->xmax = pdest->x[i];
       if (pdest->y[i] < pdest->ymin)
         pdest->ymin = pdest->y[i];
       if (pdest->y[i] > pdest->ymax)
@@ -847,7 +1059,58 @@ raw_to_user_plots (PlotData *pdest, int num_recs, float x_raw[NSIZE],
   pdest->zm_starty = 0;
   pdest->zm_endx = 0;
   pdest->zm_endy = 0;
-  return;
+  return 0;
+}
+
+/* Extend a plot drawn from the shared columns with the records they have
+ * gained since it was converted, rather than converting it all again.  The
+ * labels stay; the extents, view and level of detail take in the new
+ * records.  Returns 0 on success, 1 if memory could not be had (leaving the
+ * plot as it was).
+ */
+int
+extend_user_plot (PlotData *pdest, ActivityData *act)
+{
+  int from = pdest->num_pts;
+  int to = pdest->xcol->len;
+  if (to <= from)
+    return 0;
+  /* y keeps the same room as the columns, which may have grown. */
+  PLFLT *y = (PLFLT *)realloc (pdest->y, pdest->xcol->cap * sizeof (PLFLT));
+  if (y == NULL)
+    return 1;
+  pdest->y = y;
+  pdest->x = pdest->xcol->v;
+  pdest->lat = pdest->latcol->v;
+  pdest->lng = pdest->lngcol->v;
+  float y_cnv;
+  float *y_raw = plot_y_raw (pdest, act, &y_cnv);
+  for (int i = from; i < to; i++)
+    {
+      pdest->y[i] = (PLFLT)y_raw[i] * y_cnv;
+      if (pdest->y[i] < pdest->ymin)
+        pdest->ymin = pdest->y[i];
+      if (pdest->y[i] > pdest->ymax)
+        pdest->ymax = pdest->y[i];
+    }
+  pdest->num_pts = to;
+  pdest->generation = next_plot_generation ();
+  /* A pyramid given up on (x out of order, or short of memory) stays given
+   * up on, and the plot is drawn in full.
+   */
+  pdest->lod = lod_extend (pdest->lod, pdest->x, pdest->y, pdest->num_pts);
+  pdest->xmin = pdest->xcol->min;
+  pdest->xmax = pdest->xcol->max;
+  /* Set the view to the data extents. */
+  pdest->vw_xmax = pdest->xmax;
+  pdest->vw_ymin = pdest->ymin;
+  pdest->vw_ymax = pdest->ymax;
+  pdest->vw_xmin = pdest->xmin;
+  pdest->zm_startx = 0;
+  pdest->zm_starty = 0;
+  pdest->zm_endx = 0;
+  pdest->zm_endy = 0;
+  return 0;
 }
 
 /* Read the first 14 bytes of the file to see if it is a fit format file. */
@@ -878,10 +1141,27 @@ is_fit_file (char *fname)
     }
 }
 
-/* Read the raw file data, call helper routines to convert to user-facing
-   values. */
-gboolean
-init_plot_data (AllData *pall)
+/* Derive a plot's display values if they are out of date.  Returns 0 on
+ * success, 1 if memory could not be had (the plot is then left empty, and
+ * tried again the next time it is needed).
+ */
+int
+materialize_plot (PlotData *pd, AllData *pall)
+{
+  if (pd->stale)
+    {
+      if (raw_to_user_plots (pd, pall->pact, pall->pcols) != 0)
+        return 1;
+      pd->stale = FALSE;
+    }
+  return 0;
+}
+
+/* Convert the raw values held in pall->pact to user-facing values in the
+   currently selected unit system.  No file access.
+   Returns 0 on success, 1 if memory could not be had. */
+int
+convert_plot_data (AllData *pall)
 {
   /* Unit system first. */
   gchar *user_units = gtk_combo_box_text_get_active_text (cb_Units);
@@ -905,266 +1185,382 @@ init_plot_data (AllData *pall)
     }
   g_free (user_units);
 
-  /* Take one of two paths, parsing the user's file and converting to user-
-     facing values. */
+  /* Only one plot is shown at a time, so each is converted the first time
+   * it is needed.  The pace plot always is: it colors the map and the
+   * splits. */
+  int failed = build_plot_columns (pall->pcols, pall->pact,
+                                   pall->ppace->units);
+  pall->ppace->stale = TRUE;
+  pall->pcadence->stale = TRUE;
+  pall->pheart->stale = TRUE;
+  pall->paltitude->stale = TRUE;
+  pall->plap->stale = TRUE;
+  failed |= materialize_plot (pall->ppace, pall);
+  failed |= materialize_plot (pall->pd, pall);
+  raw_to_user_session (pall->psd, pall->pact);
+  return failed;
+}
 
-  if (is_fit_file (fname))
-    {
-      /* FIT file */
-      /* Parse the data from the fit file in a cGO routine and return the
-       * result as a structure defined by fitwrapper.go.
-       */
-      result = parse_fit_file (fname, NSIZE, LSIZE);
-      // Not a fit file or could not read.
-      if (result.r0)
-        {
-          GtkDialogFlags flags = GTK_DIALOG_DESTROY_WITH_PARENT;
-          GtkWidget *dialog;
-          dialog = gtk_message_dialog_new (NULL, flags, GTK_MESSAGE_ERROR,
-                                           GTK_BUTTONS_CLOSE,
-                                           "Error loading“%s”.\n File missing, "
-                                           "corrupt, or wrong type.\n Try "
-                                           "another file.",
-                                           fname);
-          gtk_dialog_run (GTK_DIALOG (dialog));
-          gtk_widget_destroy (dialog);
-          return FALSE;
-        }
-      //  long  *pRecTimestamp = result.r2;
-      float *prec_distance = result.r4;
-      float *prec_speed = result.r6;
-      float *prec_altitude = result.r8;
-      float *prec_cadence = result.r10;
-      float *prec_heartrate = result.r12;
-      float *prec_lat = result.r14;
-      float *prec_long = result.r16;
-      long nRecs = result.r17;
-      //  long  *pLapTimestamp = result.r19;
-      float *plap_total_distance = result.r21;
-      float *plap_start_position_lat = result.r23;
-      float *plap_start_position_long = result.r25;
-      //  float *plap_end_position_lat = result.r27;
-      //  float *plap_end_position_long = result.r29;
-      //  float *plap_total_calories = result.r31;
-      float *plap_total_elapsed_time = result.r33;
-      //  float *pLapTotalTimerTime = result.r35;
-      long nLaps = result.r36;
-      long sess_timestamp = result.r37;
-      long sess_start_time = result.r38;
-      float sess_start_position_lat = result.r39;
-      float sess_start_position_long = result.r40;
-      float sess_total_elapsed_time = result.r41;
-      float sess_total_timer_time = result.r42;
-      float sess_total_distance = result.r43;
-      float sess_nec_latitude = result.r44;
-      float sess_nec_longitude = result.r45;
-      float sess_swc_latitude = result.r46;
-      float sess_swc_longitude = result.r47;
-      float sess_total_work = result.r48;
-      float sess_total_moving_time = result.r49;
-      float sess_average_lap_time = result.r50;
-      float sess_total_calories = result.r51;
-      float sess_avg_speed = result.r52;
-      float sess_max_speed = result.r53;
-      float sess_total_ascent = result.r54;
-      float sess_total_descent = result.r55;
-      float sess_avg_altitude = result.r56;
-      float sess_max_altitude = result.r57;
-      float sess_min_altitude = result.r58;
-      float sess_avg_heartrate = result.r59;
-      float sess_max_heartrate = result.r60;
-      float sess_min_heartrate = result.r61;
-      float sess_avg_cadence = result.r62;
-      float sess_max_cadence = result.r63;
-      float sess_avg_temperature = result.r64;
-      float sess_max_temperature = result.r65;
-      float sess_total_anaerobic_training_effect = result.r66;
-      long time_zone_offset = result.r67;
-
-      /* Convert the raw values to user-facing values. */
-      raw_to_user_plots (pall->ppace, nRecs, prec_distance, prec_speed,
-                         prec_lat, prec_long, sess_start_time,
-                         time_zone_offset);
-      raw_to_user_plots (pall->pcadence, nRecs, prec_distance, prec_cadence,
-                         prec_lat, prec_long, sess_start_time,
-                         time_zone_offset);
-      raw_to_user_plots (pall->pheart, nRecs, prec_distance, prec_heartrate,
-                         prec_lat, prec_long, sess_start_time,
-                         time_zone_offset);
-      raw_to_user_plots (pall->paltitude, nRecs, prec_distance, prec_altitude,
-                         prec_lat, prec_long, sess_start_time,
-                         time_zone_offset);
-      raw_to_user_plots (pall->plap, nLaps, plap_total_distance,
-                         plap_total_elapsed_time, plap_start_position_lat,
-                         plap_start_position_long, sess_start_time,
-                         time_zone_offset);
-
-      /* Convert the raw values to user-facing values. */
-      raw_to_user_session (
-          pall->psd, sess_timestamp, sess_start_time, sess_start_position_lat,
-          sess_start_position_long, sess_total_elapsed_time,
-          sess_total_timer_time, sess_total_distance, sess_nec_latitude,
-          sess_nec_longitude, sess_swc_latitude, sess_swc_longitude,
-          sess_total_work, sess_total_moving_time, sess_average_lap_time,
-          sess_total_calories, sess_avg_speed, sess_max_speed,
-          sess_total_ascent, sess_total_descent, sess_avg_altitude,
-          sess_max_altitude, sess_min_altitude, sess_max_heartrate,
-          sess_avg_heartrate, sess_max_cadence, sess_avg_cadence,
-          sess_avg_temperature, sess_max_temperature, sess_min_heartrate,
-          sess_total_anaerobic_training_effect, time_zone_offset);
+/* Take in the records added to pall->pact since the plots were last
+ * converted or extended, while a file is still loading.  Only the plots
+ * already converted change, and only by the new records; the rest are
+ * converted in full when they are first needed, as ever.  The laps and the
+ * session summary wait for convert_plot_data at the end of the load.
+ * Returns 0 on success, 1 if memory could not be had.
+ */
+int
+extend_plot_data (AllData *pall)
+{
+  PlotData *plots[]
+      = { pall->ppace, pall->pcadence, pall->pheart, pall->paltitude };
+  if (extend_plot_columns (pall->pcols, pall->pact, pall->ppace->units) != 0)
+    return 1;
+  int failed = 0;
+  for (int i = 0; i < 4; i++)
+    if (!plots[i]->stale && plots[i]->xcol == pall->pcols->x)
+      failed |= extend_user_plot (plots[i], pall->pact);
+  failed |= materialize_plot (pall->pd, pall);
+  return failed;
+}
 
-      return TRUE;
+/* Read one session of a file into act (initialized by the caller with
+ * activity_init), from the cache if it can be, reporting progress through
+ * prog.  Touches no GUI state, so it may run on any thread.
+ * Returns 0 on success, 1 on failure or cancellation.
+ */
+int
+load_activity (char *path, long session, ActivityData *act,
+               ActivityProgress *prog)
+{
+  /* Take one of two paths, parsing the user's file into the common
+     activity representation. */
+  int failed;
+  if (cache_load (path, session, act) == 0)
+    {
+      /* Decoded before and unchanged since (cache.c). */
+      failed = 0;
     }
   else
     {
-      /* TCX file */
-      /* Parse the fit file (in a C routine) and return the results. */
-      result_type *p_tcx = (result_type *)malloc (sizeof (result_type));
-
-      if (create_arrays_from_tcx_file (fname, NSIZE, LSIZE, p_tcx) == 1)
+      if (is_fit_file (path))
         {
-          GtkDialogFlags flags = GTK_DIALOG_DESTROY_WITH_PARENT;
-          GtkWidget *dialog;
-          dialog = gtk_message_dialog_new (NULL, flags, GTK_MESSAGE_ERROR,
-                                           GTK_BUTTONS_CLOSE,
-                                           "Error loading“%s”.\n File missing, "
-                                           "corrupt, or wrong type.\n Try "
-                                           "another file.",
-                                           fname);
-          gtk_dialog_run (GTK_DIALOG (dialog));
-          gtk_widget_destroy (dialog);
-          return FALSE;
+          /* FIT file, parsed in a cGO routine (fitwrapper.go). */
+          failed = parse_fit_file (path, session, act, prog);
         }
-
-      /* Convert the raw values to user-facing values. */
-      raw_to_user_plots (pall->ppace, p_tcx->nRecs, p_tcx->prec_distance,
-                         p_tcx->prec_speed, p_tcx->prec_lat, p_tcx->prec_long,
-                         p_tcx->sess_start_time, p_tcx->time_zone_offset);
-      raw_to_user_plots (pall->pcadence, p_tcx->nRecs, p_tcx->prec_distance,
-                         p_tcx->prec_cadence, p_tcx->prec_lat, p_tcx->prec_long,
-                         p_tcx->sess_start_time, p_tcx->time_zone_offset);
-      raw_to_user_plots (pall->pheart, p_tcx->nRecs, p_tcx->prec_distance,
-                         p_tcx->prec_heartrate, p_tcx->prec_lat,
-                         p_tcx->prec_long, p_tcx->sess_start_time,
-                         p_tcx->time_zone_offset);
-      raw_to_user_plots (pall->paltitude, p_tcx->nRecs, p_tcx->prec_distance,
-                         p_tcx->prec_altitude, p_tcx->prec_lat,
-                         p_tcx->prec_long, p_tcx->sess_start_time,
-                         p_tcx->time_zone_offset);
-      raw_to_user_plots (pall->plap, p_tcx->nLaps, p_tcx->plap_total_distance,
-                         p_tcx->plap_total_elapsed_time,
-                         p_tcx->plap_start_position_lat,
-                         p_tcx->plap_start_position_long,
-                         p_tcx->sess_start_time, p_tcx->time_zone_offset);
-
-      /* Convert the raw values to user-facing values. */
-      raw_to_user_session (
-          pall->psd, p_tcx->sess_timestamp, p_tcx->sess_start_time,
-          p_tcx->sess_start_position_lat, p_tcx->sess_start_position_long,
-          p_tcx->sess_total_elapsed_time, p_tcx->sess_total_timer_time,
-          p_tcx->sess_total_distance, p_tcx->sess_nec_latitude,
-          p_tcx->sess_nec_longitude, p_tcx->sess_swc_latitude,
-          p_tcx->sess_swc_longitude, p_tcx->sess_total_work,
-          p_tcx->sess_total_moving_time, p_tcx->sess_average_lap_time,
-          p_tcx->sess_total_calories, p_tcx->sess_avg_speed,
-          p_tcx->sess_max_speed, p_tcx->sess_total_ascent,
-          p_tcx->sess_total_descent, p_tcx->sess_avg_altitude,
-          p_tcx->sess_max_altitude, p_tcx->sess_min_altitude,
-          p_tcx->sess_max_heartrate, p_tcx->sess_avg_heartrate,
-          p_tcx->sess_max_cadence, p_tcx->sess_avg_cadence,
-          p_tcx->sess_avg_temperature, p_tcx->sess_max_temperature,
-          p_tcx->sess_min_heartrate,
-          p_tcx->sess_total_anaerobic_training_effect, p_tcx->time_zone_offset);
-
-      /* Clean-up (for tcx files). */
-      free (p_tcx->prec_distance);
-      free (p_tcx->prec_speed);
-      free (p_tcx->prec_altitude);
-      free (p_tcx->prec_cadence);
-      free (p_tcx->prec_heartrate);
-      free (p_tcx->prec_lat);
-      free (p_tcx->prec_long);
-      free (p_tcx->plap_total_distance);
-      free (p_tcx->plap_start_position_lat);
-      free (p_tcx->plap_start_position_long);
-      free (p_tcx->plap_total_elapsed_time);
-      free (p_tcx);
-      return TRUE;
+      else
+        {
+          /* TCX file, parsed in a C routine (tcxwrapper.h). */
+          failed = create_arrays_from_tcx_file (path, session, act, prog);
+        }
+      if (!failed)
+        cache_store (path, session, act);
     }
+  unsigned long hits, misses;
+  cache_stats (&hits, &misses);
+  g_debug ("activity cache: %lu hits, %lu misses", hits, misses);
+  return failed;
 }
 
-/* A custom axis labeling function for a pace plot. */
-void
-pace_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
-                   PLPointer label_data)
+/* A file load running on a worker thread.  The GUI only ever reads prog
+ * while the job runs; act is handed over once it is done.
+ */
+typedef struct LoadJob
 {
-  PLFLT pace_units = 0.0;
-  if (axis == PL_Y_AXIS)
-    {
-      if (value > 0)
-        pace_units = 1 / value;
-      else
-        pace_units = 99.0;
-      double secs, mins;
-      secs = modf (pace_units, &mins);
-      secs *= 60.0;
-      if (secs >= 59.5) {secs = 0.0; mins += 1.0;}
-      snprintf (label, (size_t)length, "%02.0f:%02.0f", mins, secs);
-    }
+  char *fname;
+  long session;
+  ActivityData act;
+  ActivityProgress prog;
+  int failed;
+  long shown; // records already on display
+} LoadJob;
+
+/* The load whose result will be displayed, if one is running. */
+static LoadJob *current_load = NULL;
+static guint load_progress_id = 0;
+/* The load whose columns the display is borrowing, if it is not done. */
+static LoadJob *shown_load = NULL;
 
-  if (axis == PL_X_AXIS)
-    snprintf (label, (size_t)length, "%3.2f", value);
+static void
+load_job_free (gpointer data)
+{
+  LoadJob *job = (LoadJob *)data;
+  g_free (job->fname);
+  activity_free (&job->act);
+  g_free (job);
 }
 
-/* A custom axis labeling function for a cadence plot. */
-void
-cadence_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
-                      PLPointer label_data)
+static void
+load_thread (GTask *task, gpointer source, gpointer task_data,
+             GCancellable *cancellable)
 {
-  if (axis == PL_Y_AXIS)
-    snprintf (label, (size_t)length, "%3.2f", value);
-  if (axis == PL_X_AXIS)
-    snprintf (label, (size_t)length, "%3.2f", value);
+  LoadJob *job = (LoadJob *)task_data;
+  job->failed = load_activity (job->fname, job->session, &job->act,
+                               &job->prog);
 }
 
-/* A custom axis labeling function for a heart rate plot. */
-void
-heart_rate_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
-                         PLPointer label_data)
+/* Show the progress bar and cancel button only while a load runs. */
+static void
+show_load_progress (gboolean show)
 {
-  if (axis == PL_Y_AXIS)
-    snprintf (label, (size_t)length, "%3.0f", value);
-  if (axis == PL_X_AXIS)
-    snprintf (label, (size_t)length, "%3.2f", value);
+  gtk_progress_bar_set_fraction (pb_Load, 0.0);
+  gtk_widget_set_visible (GTK_WIDGET (pb_Load), show);
+  gtk_widget_set_visible (GTK_WIDGET (btn_Cancel), show);
 }
 
-/* A custom axis labeling function for an altitude plot. */
-void
-altitude_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
-                       PLPointer label_data)
+void redraw_all (AllData *pall);
+void show_widgets (gboolean show);
+
+/* Tell the user a file could not be shown, and why. */
+static void
+show_load_error (const char *path, const char *why)
 {
-  if (axis == PL_Y_AXIS)
-    snprintf (label, (size_t)length, "%3.0f", value);
-  if (axis == PL_X_AXIS)
-    snprintf (label, (size_t)length, "%3.2f", value);
+  GtkDialogFlags flags = GTK_DIALOG_DESTROY_WITH_PARENT;
+  GtkWidget *dialog;
+  dialog = gtk_message_dialog_new (NULL, flags, GTK_MESSAGE_ERROR,
+                                   GTK_BUTTONS_CLOSE,
+                                   "Error loading“%s”.\n %s\n Try "
+                                   "another file.",
+                                   path, why);
+  gtk_dialog_run (GTK_DIALOG (dialog));
+  gtk_widget_destroy (dialog);
 }
+static void extend_map (AllData *data, long from, long to);
 
-/* Draw an xy plot. */
+/* Let go of the activity on display.  It owns its columns unless it is
+ * borrowing those of a load still running.
+ */
+static void
+release_display (AllData *pall)
+{
+  if (shown_load == NULL)
+    activity_free (pall->pact);
+  else
+    activity_init (pall->pact);
+  shown_load = NULL;
+}
 
-void
-draw_xy (PlotData *pd, int width, int height)
+/* Display the first nrecs records of a load that is still running.  The
+ * plot, map track and slider range grow as more arrive; the laps and the
+ * session summary wait for the load to finish.
+ */
+static void
+show_partial (AllData *pall, LoadJob *job, long nrecs)
 {
-  float ch_size = 4.0; // mm
-  float scf = 1.0;     // dimensionless
-  PLFLT x_hair = 0;
-  PLFLT hairline_x[2], hairline_y[2];
-  if ((pd->x != NULL) && (pd->y != NULL))
+  ActivityData *act = pall->pact;
+  if (shown_load != job)
     {
-      /* Do your drawing. */
-      /* Color */
-      plscol0a (1, 65, 209, 65, 0.25);   // light green for selector
-      plscol0a (15, 92, 92, 92, 1.0); // light gray for foreground
-      plscol0a (10, 92, 92, 92, 0.5); // lighter gray for hairline
+      release_display (pall);
+      shown_load = job;
+      /* Published records are never moved, so they can be read in place. */
+      act->rec_time = job->act.rec_time;
+      act->rec_distance = job->act.rec_distance;
+      act->rec_speed = job->act.rec_speed;
+      act->rec_altitude = job->act.rec_altitude;
+      act->rec_cadence = job->act.rec_cadence;
+      act->rec_heartrate = job->act.rec_heartrate;
+      act->rec_lat = job->act.rec_lat;
+      act->rec_long = job->act.rec_long;
+      act->sess.start_time = (time_t)act->rec_time[0];
+      /* Start the slider over on the new run. */
+      curr_idx = 0;
+      gtk_range_set_value (GTK_RANGE (sc_IdxPct), 0.0);
+      job->shown = 0;
+    }
+  act->nrecs = nrecs;
+  /* The first records are converted in full, the rest as they arrive.
+   * Short of memory, wait for the whole run; the load reports it then.
+   */
+  int failed = job->shown == 0 ? convert_plot_data (pall)
+                               : extend_plot_data (pall);
+  if (failed)
+    return;
+  extend_map (pall, job->shown, nrecs);
+  job->shown = nrecs;
+  gtk_widget_queue_draw (GTK_WIDGET (da));
+  /* The splits have nothing to show until the laps are read. */
+  if (pall->pd->num_pts > 0)
+    g_signal_emit_by_name (sc_IdxPct, "value-changed");
+}
+
+/* Copy the running load's progress into the progress bar, and display
+ * whatever records it has published since the last tick.  Redrawing at
+ * this rate rather than per batch keeps the display from falling behind.
+ */
+static gboolean
+on_load_progress (gpointer user_data)
+{
+  AllData *pall = (AllData *)user_data;
+  if (current_load == NULL)
+    {
+      load_progress_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+  gtk_progress_bar_set_fraction (
+      pb_Load, activity_progress_fraction (&current_load->prog));
+  ActivityBatch batch;
+  long nrecs = current_load->shown;
+  while (activity_progress_next_batch (&current_load->prog, &batch))
+    nrecs = batch.first + batch.count;
+  if (nrecs > current_load->shown
+      && !activity_progress_cancelled (&current_load->prog))
+    show_partial (pall, current_load, nrecs);
+  return G_SOURCE_CONTINUE;
+}
+
+/* Back on the main thread once a load has finished, been cancelled, or been
+ * superseded by a later one.
+ */
+static void
+on_load_done (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+  AllData *pall = (AllData *)user_data;
+  LoadJob *job = (LoadJob *)g_task_get_task_data (G_TASK (res));
+  /* If part of this load is on display, the display takes its columns. */
+  gboolean adopted = (job == shown_load);
+  if (adopted)
+    {
+      *pall->pact = job->act;
+      activity_init (&job->act);
+      shown_load = NULL;
+    }
+  /* A later load has taken over the display; drop this one. */
+  if (job != current_load)
+    return;
+  current_load = NULL;
+  show_load_progress (FALSE);
+  gboolean cancelled = activity_progress_cancelled (&job->prog);
+  if ((cancelled || job->failed) && adopted)
+    {
+      /* Do not leave half a run on display. */
+      release_display (pall);
+      osm_gps_map_track_remove_all (map);
+      show_widgets (FALSE);
+    }
+  if (cancelled)
+    return;
+  // Not a fit file or could not read.
+  if (job->failed)
+    {
+      show_load_error (job->fname, "File missing, corrupt, or wrong type.");
+      return;
+    }
+
+  /* Keep the raw values in place of the previous file's. */
+  if (!adopted)
+    {
+      release_display (pall);
+      *pall->pact = job->act;
+      activity_init (&job->act);
+    }
+  num_sessions = pall->pact->nsessions;
+
+  /* The plots are read by the draw handler, so conversion stays here on
+   * the main thread.
+   */
+  if (convert_plot_data (pall) != 0)
+    {
+      release_display (pall);
+      osm_gps_map_track_remove_all (map);
+      show_widgets (FALSE);
+      show_load_error (job->fname, "Not enough memory to display it.");
+      return;
+    }
+  redraw_all (pall);
+}
+
+/* Start reading the current file and session on a worker thread, in place
+ * of any load already running.  The display is updated when it finishes.
+ */
+void
+init_plot_data (AllData *pall)
+{
+  if (current_load != NULL)
+    activity_progress_cancel (&current_load->prog);
+
+  LoadJob *job = g_new0 (LoadJob, 1);
+  job->fname = g_strdup (fname);
+  job->session = session_index;
+  activity_init (&job->act);
+  current_load = job;
+
+  GTask *task = g_task_new (NULL, NULL, on_load_done, pall);
+  g_task_set_task_data (task, job, load_job_free);
+  g_task_run_in_thread (task, load_thread);
+  g_object_unref (task);
+
+  show_load_progress (TRUE);
+  if (load_progress_id == 0)
+    load_progress_id = g_timeout_add (100, on_load_progress, pall);
+}
+
+/* A custom axis labeling function for a pace plot. */
+void
+pace_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
+                   PLPointer label_data)
+{
+  PLFLT pace_units = 0.0;
+  if (axis == PL_Y_AXIS)
+    {
+      if (value > 0)
+        pace_units = 1 / value;
+      else
+        pace_units = 99.0;
+      double secs, mins;
+      secs = modf (pace_units, &mins);
+      secs *= 60.0;
+      if (secs >= 59.5) {secs = 0.0; mins += 1.0;}
+      snprintf (label, (size_t)length, "%02.0f:%02.0f", mins, secs);
+    }
+
+  if (axis == PL_X_AXIS)
+    snprintf (label, (size_t)length, "%3.2f", value);
+}
+
+/* A custom axis labeling function for a cadence plot. */
+void
+cadence_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
+                      PLPointer label_data)
+{
+  if (axis == PL_Y_AXIS)
+    snprintf (label, (size_t)length, "%3.2f", value);
+  if (axis == PL_X_AXIS)
+    snprintf (label, (size_t)length, "%3.2f", value);
+}
+
+/* A custom axis labeling function for a heart rate plot. */
+void
+heart_rate_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
+                         PLPointer label_data)
+{
+  if (axis == PL_Y_AXIS)
+    snprintf (label, (size_t)length, "%3.0f", value);
+  if (axis == PL_X_AXIS)
+    snprintf (label, (size_t)length, "%3.2f", value);
+}
+
+/* A custom axis labeling function for an altitude plot. */
+void
+altitude_plot_labeler (PLINT axis, PLFLT value, char *label, PLINT length,
+                       PLPointer label_data)
+{
+  if (axis == PL_Y_AXIS)
+    snprintf (label, (size_t)length, "%3.0f", value);
+  if (axis == PL_X_AXIS)
+    snprintf (label, (size_t)length, "%3.2f", value);
+}
+
+/* Draw an xy plot, or in draft only the data and a bare box around it. */
+
+void
+draw_xy (PlotData *pd, gboolean draft)
+{
+  float ch_size = 4.0; // mm
+  float scf = 1.0;     // dimensionless
+  if ((pd->x != NULL) && (pd->y != NULL))
+    {
+      /* Do your drawing. */
+      /* Color */
+      plscol0a (15, 92, 92, 92, 1.0); // light gray for foreground
       plscol0a (2, pd->linecolor[0], pd->linecolor[1], pd->linecolor[2], 0.8);
       plwind (pd->vw_xmin, pd->vw_xmax, pd->vw_ymin, pd->vw_ymax);
       /* Adjust character size. */
@@ -1190,49 +1586,17 @@ draw_xy (PlotData *pd, int width, int height)
         }
       /* Create a labelled box to hold the plot using custom x,y labels. */
       // We want finer control here, so we ignore the convenience function.
-      char *xopt = "bnost";
-      char *yopt = "bgnost";
-      // TODO valgrind reports mem lost on below line...
+      char *xopt = draft ? "bst" : "bnost";
+      char *yopt = draft ? "bst" : "bgnost";
       plaxes (pd->vw_xmin, pd->vw_ymin, xopt, 0, 0, yopt, 0, 0);
       /* Setup axis labels and titles. */
-      pllab (pd->xaxislabel, pd->yaxislabel, pd->start_time);
+      if (!draft)
+        pllab (pd->xaxislabel, pd->yaxislabel, pd->start_time);
       /* Set line color to the second pallette color. */
       plcol0 (2);
       /* Plot the data that was loaded. */
       plwidth (2);
       plline (pd->num_pts, pd->x, pd->y);
-      /*  Draw_selection box "rubber-band". */
-      PLFLT rb_x[4];
-      PLFLT rb_y[4];
-      rb_x[0] = pd->zm_startx;
-      rb_y[0] = pd->zm_starty;
-      rb_x[1] = pd->zm_startx;
-      rb_y[1] = pd->zm_endy;
-      rb_x[2] = pd->zm_endx;
-      rb_y[2] = pd->zm_endy;
-      rb_x[3] = pd->zm_endx;
-      rb_y[3] = pd->zm_starty;
-      if ((pd->zm_startx != pd->zm_endx) && (pd->zm_starty != pd->zm_endy))
-        {
-          plcol0 (1);
-          plfill (4, rb_x, rb_y);
-        }
-      /* Add a hairline */
-      plcol0 (10);
-      /* If we are between the view limits, draw a line from the
-       * current index on the x scale from the bottom to the top
-       * of the view. */
-      x_hair = pd->x[curr_idx];
-      if ((x_hair >= pd->vw_xmin) && (x_hair <= pd->vw_xmax))
-        {
-          hairline_x[0] = x_hair;
-          hairline_x[1] = x_hair;
-          hairline_y[0] = pd->vw_ymin;
-          hairline_y[1] = pd->vw_ymax;
-          pllsty (2);
-          plline (2, hairline_x, hairline_y);
-          pllsty (1);
-        }
     }
 }
 
@@ -1249,9 +1613,9 @@ plfbox (PLFLT x0, PLFLT y0, PLINT color)
   plline (4, x, y);
 }
 
-/* Draw a bar chart */
+/* Draw a bar chart, highlighting the first done bars. */
 void
-draw_bar (PlotData *plap, PlotData *ppace, int width, int height)
+draw_bar (PlotData *plap, int done)
 {
   char string[8];
   if (plap->num_pts > 0)
@@ -1267,13 +1631,11 @@ draw_bar (PlotData *plap, PlotData *ppace, int width, int height)
       // Highlight (progress) color.
       plscol0a (3, plap->linecolor[0], plap->linecolor[1], plap->linecolor[2],
                 0.5);
-      float tot_dist = 0.0;
       for (int i = 0; i < plap->num_pts - 1; i++)
         {
-          tot_dist = plap->x[i] + tot_dist;
           plcol0 (15);
           plpsty (0);
-          if (ppace->x[curr_idx] > tot_dist)
+          if (i < done)
             plfbox (i, plap->y[i], 3);
           else
             plfbox (i, plap->y[i], 2);
@@ -1307,6 +1669,647 @@ checkRadioButtons ()
   return LapPlot;
 }
 
+/* Select the PLplot stream for a type of plot and point it at the cairo
+ * context cr.  The stream is created and initialized the first time that
+ * type is drawn and kept from then on, so a render only redoes the page
+ * itself.  Only the render thread calls PLplot, so the streams are its own.
+ */
+static void
+begin_plot_stream (enum PlotType ptype, cairo_t *cr)
+{
+  static PLINT streams[LapPlot + 1] = { -1, -1, -1, -1, -1, -1 };
+  if (streams[ptype] < 0)
+    {
+      plmkstrm (&streams[ptype]);
+      plsdev ("extcairo");
+      /* Device attributes */
+      plspage (0.0, 0.0, PAGE_WIDTH, PAGE_HEIGHT, 0, 0);
+      /* Plot background color transparent, alpha=0 */
+      plscolbga ( 0 , 0, 0, 0 );
+      plinit ();
+    }
+  else
+    {
+      plsstrm (streams[ptype]);
+    }
+  pl_cmd (PLESC_DEVINIT, cr);
+}
+
+/* The static part of a plot (axes, labels and data) as rendered, and what
+ * it was rendered for.  The hairline and zoom box are drawn over it on every
+ * frame.
+ */
+typedef struct PlotLayer
+{
+  cairo_surface_t *surface;
+  gsize bytes;      // held by surface
+  PlotData *pd;     // plot rendered
+  enum PlotType ptype;
+  enum UnitSystem units;
+  guint generation; // of pd's display values
+  PLFLT vw_xmin, vw_xmax, vw_ymin, vw_ymax;
+  int width, height;
+  int laps_done; // splits only: bars shown as passed
+  gboolean draft; // drawn while the view was moving (draw_xy)
+  /* Where the page sits in the drawing area, and the plot viewport on the
+   * page (normalized), for placing the overlays.
+   */
+  double offx, offy, scale;
+  PLFLT vpxmin, vpxmax, vpymin, vpymax;
+} PlotLayer;
+
+/* Memory the rendered layers may hold, in megabytes.  The environment
+ * variable SILICONSNEAKER_PLOT_CACHE_MB overrides it.
+ */
+#define PLOT_CACHE_MB 32
+
+/* Rendered layers, most recently used first, so that switching charts or
+ * returning to an earlier view is a blit rather than a render.
+ */
+static GQueue plot_layers = G_QUEUE_INIT;
+static gsize plot_layer_bytes = 0;
+static guint plot_layer_hits = 0;
+static guint plot_layer_misses = 0;
+
+/* Report how long each plot frame took to draw, the mean so far, and how
+ * the layer cache is doing, when debug messages are enabled
+ * (G_MESSAGES_DEBUG=all).
+ */
+static void
+log_frame_time (gint64 usec)
+{
+  static gint64 total = 0;
+  static long frames = 0;
+  total += usec;
+  frames++;
+  g_debug ("plot frame: %.2f ms (mean %.2f ms over %ld frames), "
+           "layer cache %u hits, %u misses, %" G_GSIZE_FORMAT " bytes",
+           usec / 1000.0, total / 1000.0 / frames, frames, plot_layer_hits,
+           plot_layer_misses, plot_layer_bytes);
+}
+
+/* How many splits the slider has passed; draw_bar highlights those. */
+static int
+laps_done (PlotData *plap, PlotData *ppace)
+{
+  float tot_dist = 0.0;
+  int done = 0;
+  if (ppace->num_pts == 0)
+    return 0;
+  for (int i = 0; i < plap->num_pts - 1; i++)
+    {
+      tot_dist = plap->x[i] + tot_dist;
+      if (ppace->x[curr_idx] > tot_dist)
+        done++;
+    }
+  return done;
+}
+
+/* Does the layer show this chart as it would be rendered now? */
+static gboolean
+plot_layer_matches (PlotLayer *layer, PlotData *shown, int width, int height,
+                    int done, gboolean draft)
+{
+  return layer->pd == shown && layer->ptype == shown->ptype
+         && layer->units == shown->units
+         && layer->generation == shown->generation
+         && layer->vw_xmin == shown->vw_xmin
+         && layer->vw_xmax == shown->vw_xmax
+         && layer->vw_ymin == shown->vw_ymin
+         && layer->vw_ymax == shown->vw_ymax && layer->width == width
+         && layer->height == height && layer->laps_done == done
+         && layer->draft == draft;
+}
+
+static void
+plot_layer_free (PlotLayer *layer)
+{
+  cairo_surface_destroy (layer->surface);
+  g_free (layer);
+}
+
+/* Find a layer showing this chart as it would be rendered now, and mark it
+ * the most recently used.  Returns NULL if there is none.
+ */
+static PlotLayer *
+plot_layer_lookup (PlotData *shown, int width, int height, int done,
+                   gboolean draft)
+{
+  for (GList *l = plot_layers.head; l != NULL; l = l->next)
+    {
+      PlotLayer *layer = (PlotLayer *)l->data;
+      if (plot_layer_matches (layer, shown, width, height, done, draft))
+        {
+          g_queue_unlink (&plot_layers, l);
+          g_queue_push_head_link (&plot_layers, l);
+          return layer;
+        }
+    }
+  return NULL;
+}
+
+/* The most recently used layer of the plot's current values, whatever view
+ * or size it was rendered for, or NULL.
+ */
+static PlotLayer *
+plot_layer_latest (PlotData *shown)
+{
+  for (GList *l = plot_layers.head; l != NULL; l = l->next)
+    {
+      PlotLayer *layer = (PlotLayer *)l->data;
+      if (layer->pd == shown && layer->generation == shown->generation)
+        return layer;
+    }
+  return NULL;
+}
+
+/* Keep a newly rendered layer, making room for it within the budget. */
+static void
+plot_layer_insert (PlotLayer *layer)
+{
+  static gsize budget = 0;
+  if (budget == 0)
+    {
+      const gchar *mb = g_getenv ("SILICONSNEAKER_PLOT_CACHE_MB");
+      budget = (gsize)((mb != NULL && atoi (mb) > 0) ? atoi (mb)
+                                                     : PLOT_CACHE_MB)
+               << 20;
+    }
+  /* Layers of a plot's earlier values can never be shown again, and a
+   * draft is only worth keeping until the next one.
+   */
+  GList *l = plot_layers.head;
+  while (l != NULL)
+    {
+      GList *next = l->next;
+      PlotLayer *old = (PlotLayer *)l->data;
+      if (old->pd == layer->pd
+          && (old->generation != layer->generation
+              || (old->draft && layer->draft)))
+        {
+          g_queue_delete_link (&plot_layers, l);
+          plot_layer_bytes -= old->bytes;
+          plot_layer_free (old);
+        }
+      l = next;
+    }
+  g_queue_push_head (&plot_layers, layer);
+  plot_layer_bytes += layer->bytes;
+  /* The newest layer always stays, even if it alone is over budget. */
+  while (plot_layer_bytes > budget && plot_layers.length > 1)
+    {
+      PlotLayer *old = (PlotLayer *)g_queue_pop_tail (&plot_layers);
+      plot_layer_bytes -= old->bytes;
+      plot_layer_free (old);
+    }
+}
+
+/* A request to render a chart: the layer to render it into, and a copy of
+ * the plot holding just what drawing it needs.  The render thread reads
+ * nothing else, so the plot itself may change, or be re-derived, while the
+ * render runs.
+ */
+typedef struct RenderJob
+{
+  PlotLayer *layer;
+  PlotData plot; // x, y and start_time belong to the job
+} RenderJob;
+
+/* The render thread and the request waiting for it.  A new request takes
+ * the place of one still waiting, so the thread only ever starts on the
+ * latest.
+ */
+static GThread *render_worker = NULL;
+static GMutex render_lock;
+static GCond render_wake;
+static RenderJob *render_pending = NULL; // guarded by render_lock
+static gboolean render_quit = FALSE;     // guarded by render_lock
+/* Main thread only: the last request made, until its layer comes back. */
+static RenderJob *render_latest = NULL;
+
+/* Make a request to render a chart as it is now, with a new layer for it
+ * the size of the drawing area.
+ */
+static RenderJob *
+render_job_new (PlotData *shown, int done, gboolean draft, GdkWindow *window,
+                int width, int height)
+{
+  RenderJob *job = g_new0 (RenderJob, 1);
+  PlotLayer *layer = g_new0 (PlotLayer, 1);
+  job->layer = layer;
+  layer->surface = gdk_window_create_similar_image_surface (
+      window, CAIRO_FORMAT_ARGB32, width, height, 0);
+  layer->bytes = (gsize)cairo_image_surface_get_stride (layer->surface)
+                 * cairo_image_surface_get_height (layer->surface);
+  /* Fit the page to the drawing area, centered. */
+  layer->scale = fmin ((double)width / PAGE_WIDTH,
+                       (double)height / PAGE_HEIGHT);
+  layer->offx = (width - PAGE_WIDTH * layer->scale) / 2.0;
+  layer->offy = (height - PAGE_HEIGHT * layer->scale) / 2.0;
+  layer->pd = shown;
+  layer->ptype = shown->ptype;
+  layer->units = shown->units;
+  layer->generation = shown->generation;
+  layer->vw_xmin = shown->vw_xmin;
+  layer->vw_xmax = shown->vw_xmax;
+  layer->vw_ymin = shown->vw_ymin;
+  layer->vw_ymax = shown->vw_ymax;
+  layer->width = width;
+  layer->height = height;
+  layer->laps_done = done;
+  layer->draft = draft;
+
+  PlotData *plot = &job->plot;
+  *plot = *shown;
+  plot->xcol = plot->latcol = plot->lngcol = NULL;
+  plot->lat = plot->lng = NULL;
+  plot->lod = NULL;
+  plot->start_time = g_strdup (shown->start_time);
+  if (shown->lod != NULL)
+    {
+      /* Distance plots: the samples in view at about two points per pixel
+       * column of the plot, using the plot viewport of the last render
+       * (or all the space the margins leave, before the first).
+       */
+      PLFLT vpwidth = shown->vw_pxmax > shown->vw_pxmin
+                          ? shown->vw_pxmax - shown->vw_pxmin
+                          : NORMXMAX - NORMXMIN;
+      long columns = (long)ceil (vpwidth * PAGE_WIDTH * layer->scale);
+      if (draft)
+        columns = columns / DRAFT_DECIMATION + 1;
+      plot->x = g_new (PLFLT, LOD_POINTS (columns));
+      plot->y = g_new (PLFLT, LOD_POINTS (columns));
+      plot->num_pts = lod_decimate (shown->lod, shown->x, shown->y,
+                                    shown->vw_xmin, shown->vw_xmax, columns,
+                                    plot->x, plot->y);
+    }
+  else
+    {
+      plot->x = g_new (PLFLT, shown->num_pts);
+      plot->y = g_new (PLFLT, shown->num_pts);
+      memcpy (plot->x, shown->x, shown->num_pts * sizeof (PLFLT));
+      memcpy (plot->y, shown->y, shown->num_pts * sizeof (PLFLT));
+    }
+  return job;
+}
+
+/* Free a job, but not its layer. */
+static void
+render_job_free (RenderJob *job)
+{
+  g_free (job->plot.x);
+  g_free (job->plot.y);
+  g_free (job->plot.start_time);
+  g_free (job);
+}
+
+/* Render the static part of a chart into the job's layer.  Render thread
+ * only.
+ */
+static void
+render_plot_layer (RenderJob *job)
+{
+  PlotLayer *layer = job->layer;
+  cairo_t *cr = cairo_create (layer->surface);
+  cairo_translate (cr, layer->offx, layer->offy);
+  cairo_scale (cr, layer->scale, layer->scale);
+  begin_plot_stream (job->plot.ptype, cr);
+  /* Viewport and window */
+  pladv (0);
+  //plvpas (NORMXMIN, NORMXMAX, NORMYMIN, NORMYMAX, (float)height / (float)width);
+  plvpas (NORMXMIN, NORMXMAX, NORMYMIN, NORMYMAX, 1.0);
+  /* Draw an xy plot or a bar chart. */
+  switch (job->plot.ptype)
+    {
+    case PacePlot:
+      draw_xy (&job->plot, layer->draft);
+      break;
+    case CadencePlot:
+      draw_xy (&job->plot, layer->draft);
+      break;
+    case HeartRatePlot:
+      draw_xy (&job->plot, layer->draft);
+      break;
+    case AltitudePlot:
+      draw_xy (&job->plot, layer->draft);
+      break;
+    case LapPlot:
+      draw_bar (&job->plot, layer->laps_done);
+      break;
+    }
+  /* Now how much padding around the plot are we actually generating? Store it
+     for use in zooming. */
+  plgvpd (&layer->vpxmin, &layer->vpxmax, &layer->vpymin, &layer->vpymax);
+  cairo_destroy (cr);
+  cairo_surface_flush (layer->surface);
+}
+
+/* Back on the main thread with a finished layer.  It is kept even if the
+ * view has moved on since, as the view may well come back to it.
+ */
+static gboolean
+on_render_done (gpointer user_data)
+{
+  RenderJob *job = (RenderJob *)user_data;
+  PlotLayer *layer = job->layer;
+  if (job == render_latest)
+    render_latest = NULL;
+  if (!render_quit && layer->generation == layer->pd->generation)
+    {
+      plot_layer_insert (layer);
+      gtk_widget_queue_draw (GTK_WIDGET (da));
+    }
+  else
+    {
+      plot_layer_free (layer);
+    }
+  render_job_free (job);
+  return G_SOURCE_REMOVE;
+}
+
+/* The render thread: render the latest request, hand the layer back to the
+ * main thread, and wait for the next.
+ */
+static gpointer
+render_thread (gpointer unused)
+{
+  for (;;)
+    {
+      g_mutex_lock (&render_lock);
+      while (render_pending == NULL && !render_quit)
+        g_cond_wait (&render_wake, &render_lock);
+      RenderJob *job = render_pending;
+      render_pending = NULL;
+      g_mutex_unlock (&render_lock);
+      if (job == NULL)
+        break;
+      gint64 start = g_get_monotonic_time ();
+      render_plot_layer (job);
+      g_debug ("plot render: %.2f ms",
+               (g_get_monotonic_time () - start) / 1000.0);
+      g_idle_add (on_render_done, job);
+    }
+  /* Close every PLplot stream the plots opened. */
+  plend ();
+  return NULL;
+}
+
+/* Hand a request to the render thread, starting the thread the first time.
+ * A request still waiting is dropped in favor of this one.
+ */
+static void
+request_render (RenderJob *job)
+{
+  g_mutex_lock (&render_lock);
+  RenderJob *stale = render_pending;
+  render_pending = job;
+  if (render_worker == NULL)
+    render_worker = g_thread_new ("plot render", render_thread, NULL);
+  g_cond_signal (&render_wake);
+  g_mutex_unlock (&render_lock);
+  if (stale != NULL)
+    {
+      plot_layer_free (stale->layer);
+      render_job_free (stale);
+    }
+  render_latest = job;
+}
+
+/* Stop the render thread once it has finished any render under way. */
+static void
+render_stop (void)
+{
+  g_mutex_lock (&render_lock);
+  RenderJob *stale = render_pending;
+  render_pending = NULL;
+  render_quit = TRUE;
+  g_cond_signal (&render_wake);
+  g_mutex_unlock (&render_lock);
+  if (stale != NULL)
+    {
+      plot_layer_free (stale->layer);
+      render_job_free (stale);
+    }
+  if (render_worker != NULL)
+    g_thread_join (render_worker);
+  render_worker = NULL;
+}
+
+/* Whether the view is being panned or wheel-zoomed, and the timeout that
+ * ends the gesture once input stops.
+ */
+static gboolean plot_gesture = FALSE;
+static guint gesture_settle_id = 0;
+
+static gboolean
+on_gesture_settled (gpointer user_data)
+{
+  plot_gesture = FALSE;
+  gesture_settle_id = 0;
+  /* Now render the view in full. */
+  gtk_widget_queue_draw (GTK_WIDGET (da));
+  return G_SOURCE_REMOVE;
+}
+
+/* Note that the view has just moved, starting or prolonging a gesture. */
+static void
+continue_gesture (void)
+{
+  plot_gesture = TRUE;
+  if (gesture_settle_id != 0)
+    g_source_remove (gesture_settle_id);
+  gesture_settle_id
+      = g_timeout_add (GESTURE_SETTLE_MS, on_gesture_settled, NULL);
+}
+
+/* A change of view shown as a short animation, from the view at start to
+ * the target.  Each frame scales and moves the last layer rendered; the
+ * plot is rendered again only once the animation is over.
+ */
+typedef struct ViewAnimation
+{
+  PlotData *pd;
+  guint generation; // of pd's values when it started
+  PLFLT from_xmin, from_xmax, from_ymin, from_ymax;
+  PLFLT to_xmin, to_xmax, to_ymin, to_ymax;
+  gint64 start;  // monotonic time, microseconds
+  guint tick_id; // the tick callback, 0 when not animating
+} ViewAnimation;
+
+static ViewAnimation view_anim;
+
+static gboolean
+on_view_animation_tick (GtkWidget *widget, GdkFrameClock *clock,
+                        gpointer user_data)
+{
+  ViewAnimation *a = &view_anim;
+  PlotData *pd = a->pd;
+  /* The values were re-derived under it; their view stands. */
+  if (pd->generation != a->generation)
+    {
+      a->tick_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+  double t = (double)(gdk_frame_clock_get_frame_time (clock) - a->start)
+             / (VIEW_ANIMATION_MS * 1000.0);
+  if (t >= 1.0)
+    t = 1.0;
+  /* Ease out: quick to respond, slowing into the target. */
+  double f = 1.0 - (1.0 - t) * (1.0 - t) * (1.0 - t);
+  pd->vw_xmin = a->from_xmin + (a->to_xmin - a->from_xmin) * f;
+  pd->vw_xmax = a->from_xmax + (a->to_xmax - a->from_xmax) * f;
+  pd->vw_ymin = a->from_ymin + (a->to_ymin - a->from_ymin) * f;
+  pd->vw_ymax = a->from_ymax + (a->to_ymax - a->from_ymax) * f;
+  gtk_widget_queue_draw (GTK_WIDGET (da));
+  if (t < 1.0)
+    return G_SOURCE_CONTINUE;
+  a->tick_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Move the plot's view to that of target, animated.  Called while an
+ * animation is running, it carries on from where the view has got to.
+ */
+static void
+animate_view (PlotData *pd, PlotData *target)
+{
+  ViewAnimation *a = &view_anim;
+  a->pd = pd;
+  a->generation = pd->generation;
+  a->from_xmin = pd->vw_xmin;
+  a->from_xmax = pd->vw_xmax;
+  a->from_ymin = pd->vw_ymin;
+  a->from_ymax = pd->vw_ymax;
+  a->to_xmin = target->vw_xmin;
+  a->to_xmax = target->vw_xmax;
+  a->to_ymin = target->vw_ymin;
+  a->to_ymax = target->vw_ymax;
+  a->start = g_get_monotonic_time ();
+  if (a->tick_id == 0)
+    a->tick_id = gtk_widget_add_tick_callback (
+        GTK_WIDGET (da), on_view_animation_tick, NULL, NULL);
+}
+
+/* Stop any animation, leaving the view where it has got to. */
+static void
+stop_view_animation (void)
+{
+  if (view_anim.tick_id != 0)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (da), view_anim.tick_id);
+  view_anim.tick_id = 0;
+}
+
+/* Paint a layer rendered for another view of the plot, scaled and moved so
+ * that its data lines up with the plot's view now.  Outside the plot area
+ * the layer is painted as it is, so the axes keep their old ticks until
+ * this view is rendered.
+ */
+static void
+paint_layer_moved (cairo_t *cr, PlotLayer *layer, PlotData *pd,
+                   cairo_rectangle_int_t *rectangle)
+{
+  /* The plot area, in drawing area coordinates. */
+  double x0 = layer->offx + layer->scale * PAGE_WIDTH * layer->vpxmin;
+  double x1 = layer->offx + layer->scale * PAGE_WIDTH * layer->vpxmax;
+  double y0 = layer->offy + layer->scale * PAGE_HEIGHT * (1.0 - layer->vpymax);
+  double y1 = layer->offy + layer->scale * PAGE_HEIGHT * (1.0 - layer->vpymin);
+  PLFLT xspan = pd->vw_xmax - pd->vw_xmin;
+  PLFLT yspan = pd->vw_ymax - pd->vw_ymin;
+  cairo_save (cr);
+  cairo_translate (cr, rectangle->x, rectangle->y);
+  cairo_rectangle (cr, 0, 0, layer->width, layer->height);
+  cairo_rectangle (cr, x0, y0, x1 - x0, y1 - y0);
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+  cairo_clip (cr);
+  cairo_set_source_surface (cr, layer->surface, 0, 0);
+  cairo_paint (cr);
+  cairo_reset_clip (cr);
+  cairo_rectangle (cr, x0, y0, x1 - x0, y1 - y0);
+  cairo_clip (cr);
+  /* Map the layer's view onto this one, x from the left edge of the plot
+   * area and y up from the bottom.
+   */
+  cairo_translate (cr, x0 + (layer->vw_xmin - pd->vw_xmin) / xspan * (x1 - x0),
+                   y1 - (layer->vw_ymin - pd->vw_ymin) / yspan * (y1 - y0));
+  cairo_scale (cr, (layer->vw_xmax - layer->vw_xmin) / xspan,
+               (layer->vw_ymax - layer->vw_ymin) / yspan);
+  cairo_translate (cr, -x0, -y1);
+  cairo_set_source_surface (cr, layer->surface, 0, 0);
+  cairo_paint (cr);
+  cairo_restore (cr);
+}
+
+/* World coordinates of the layer's plot to page coordinates. */
+static double
+layer_page_x (PlotLayer *layer, PLFLT wx)
+{
+  return PAGE_WIDTH
+         * (layer->vpxmin
+            + (wx - layer->vw_xmin) / (layer->vw_xmax - layer->vw_xmin)
+                  * (layer->vpxmax - layer->vpxmin));
+}
+
+static double
+layer_page_y (PlotLayer *layer, PLFLT wy)
+{
+  return PAGE_HEIGHT
+         * (1.0
+            - (layer->vpymin
+               + (wy - layer->vw_ymin) / (layer->vw_ymax - layer->vw_ymin)
+                     * (layer->vpymax - layer->vpymin)));
+}
+
+/* Draw what moves with the pointer and the slider over an xy plot: the
+ * zoom "rubber-band" and the hairline at the current index.
+ */
+static void
+draw_overlays (cairo_t *cr, PlotLayer *layer, PlotData *pd,
+               cairo_rectangle_int_t *rectangle)
+{
+  if ((pd->x == NULL) || (pd->y == NULL) || (pd->num_pts == 0)
+      || (layer->vw_xmax <= layer->vw_xmin)
+      || (layer->vw_ymax <= layer->vw_ymin))
+    return;
+  cairo_save (cr);
+  cairo_translate (cr, rectangle->x + layer->offx, rectangle->y + layer->offy);
+  cairo_scale (cr, layer->scale, layer->scale);
+  /* Keep to the plot area, as PLplot would. */
+  cairo_rectangle (cr, PAGE_WIDTH * layer->vpxmin,
+                   PAGE_HEIGHT * (1.0 - layer->vpymax),
+                   PAGE_WIDTH * (layer->vpxmax - layer->vpxmin),
+                   PAGE_HEIGHT * (layer->vpymax - layer->vpymin));
+  cairo_clip (cr);
+  /*  Draw_selection box "rubber-band". */
+  if ((pd->zm_startx != pd->zm_endx) && (pd->zm_starty != pd->zm_endy))
+    {
+      double x0 = layer_page_x (layer, pd->zm_startx);
+      double y0 = layer_page_y (layer, pd->zm_starty);
+      double x1 = layer_page_x (layer, pd->zm_endx);
+      double y1 = layer_page_y (layer, pd->zm_endy);
+      cairo_set_source_rgba (cr, 65 / 255.0, 209 / 255.0, 65 / 255.0, 0.25);
+      cairo_rectangle (cr, fmin (x0, x1), fmin (y0, y1), fabs (x1 - x0),
+                       fabs (y1 - y0));
+      cairo_fill (cr);
+    }
+  /* Add a hairline.  If we are between the view limits, draw a line from
+   * the current index on the x scale from the bottom to the top of the
+   * view, dashed as PLplot's line style 2.
+   */
+  PLFLT x_hair = pd->x[curr_idx];
+  if ((x_hair >= pd->vw_xmin) && (x_hair <= pd->vw_xmax))
+    {
+      static const double dash[] = { 2.835, 2.835 }; // 1 mm on, 1 mm off
+      double x = layer_page_x (layer, x_hair);
+      cairo_set_source_rgba (cr, 92 / 255.0, 92 / 255.0, 92 / 255.0, 0.5);
+      cairo_set_line_width (cr, 2.0);
+      cairo_set_dash (cr, dash, 2, 0.0);
+      cairo_move_to (cr, x, layer_page_y (layer, pd->vw_ymin));
+      cairo_line_to (cr, x, layer_page_y (layer, pd->vw_ymax));
+      cairo_stroke (cr);
+    }
+  cairo_restore (cr);
+}
+
 /* Drawing area callback.
  *
  * The GUI definition wraps a GTKDrawing area inside a GTK widget.
@@ -1321,6 +2324,7 @@ G_MODULE_EXPORT
 gboolean
 on_da_draw (GtkWidget *widget, GdkEventExpose *event, AllData *data)
 {
+  gint64 frame_start = g_get_monotonic_time ();
   cairo_rectangle_int_t rectangle;
   /* Can't plot uninitialized. */
   if ((data->pd == NULL) || (data->plap == NULL))
@@ -1336,72 +2340,85 @@ on_da_draw (GtkWidget *widget, GdkEventExpose *event, AllData *data)
   drawingContext = gdk_window_begin_draw_frame (window, cairoRegion);
   /* Say: "I want to start drawing". */
   cairo_t *cr = gdk_drawing_context_get_cairo_context (drawingContext);
-  /* Generate a colored background. */
-  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,width,height);
-  cairo_create(surface);
   // Draw a white colored background
   cairo_save(cr);
   cairo_set_source_rgb(cr, 128, 128, 128);
   cairo_paint(cr);
   cairo_restore(cr);
-  /* Initialize plplot using the svg backend. */
-  plsdev ("svg");
-  /* Device attributes */
-  char *tmpfile = path_to_temp_dir ();
-  strcat (tmpfile, "siliconsneaker.svg");
-  FILE *fp = fopen (tmpfile, "w");
-  plsfile (fp);
-  /* Plot background color transparent, alpha=0 */
-  plscolbga ( 0 , 0, 0, 0 );
-  plinit ();
-  pl_cmd (PLESC_DEVINIT, cr);
-  /* Viewport and window */
-  pladv (0);
-  //plvpas (NORMXMIN, NORMXMAX, NORMYMIN, NORMYMAX, (float)height / (float)width);
-  plvpas (NORMXMIN, NORMXMAX, NORMYMIN, NORMYMAX, 1.0);
-  /* Draw an xy plot or a bar chart. */
-  switch (checkRadioButtons ())
+  /* The axes, labels and data are rendered on the render thread, only when
+   * they have changed, and in draft while the view is dragged.  Until the
+   * render for this view is done, the last one of this plot stands in for
+   * it, moved to the view if it is an xy plot; during an animation that is
+   * all each frame does.
+   */
+  enum PlotType chart = checkRadioButtons ();
+  if (chart == LapPlot)
+    materialize_plot (data->plap, data);
+  PlotData *shown = chart == LapPlot ? data->plap : data->pd;
+  int done = chart == LapPlot ? laps_done (data->plap, data->ppace) : 0;
+  gboolean draft = plot_gesture && chart != LapPlot;
+  PlotLayer *layer = plot_layer_lookup (shown, width, height, done, FALSE);
+  if (layer == NULL && draft)
+    layer = plot_layer_lookup (shown, width, height, done, TRUE);
+  if (layer != NULL)
+    plot_layer_hits++;
+  else
     {
-    case PacePlot:
-      draw_xy (data->pd, width, height);
-      break;
-    case CadencePlot:
-      draw_xy (data->pd, width, height);
-      break;
-    case HeartRatePlot:
-      draw_xy (data->pd, width, height);
-      break;
-    case AltitudePlot:
-      draw_xy (data->pd, width, height);
-      break;
-    case LapPlot:
-      draw_bar (data->plap, data->ppace, width, height);
-      break;
+      plot_layer_misses++;
+      layer = plot_layer_latest (shown);
+      if ((layer == NULL || view_anim.tick_id == 0)
+          && (render_latest == NULL
+              || !plot_layer_matches (render_latest->layer, shown, width,
+                                      height, done, draft)))
+        request_render (
+            render_job_new (shown, done, draft, window, width, height));
+    }
+  if (layer != NULL)
+    {
+      /* Zooming works from the viewport of the chart on display. */
+      data->pd->vw_pxmin = layer->vpxmin;
+      data->pd->vw_pxmax = layer->vpxmax;
+      data->pd->vw_pymin = layer->vpymin;
+      data->pd->vw_pymax = layer->vpymax;
+      if (chart != LapPlot && layer->width == width
+          && layer->height == height && shown->vw_xmax > shown->vw_xmin
+          && shown->vw_ymax > shown->vw_ymin
+          && (layer->vw_xmin != shown->vw_xmin
+              || layer->vw_xmax != shown->vw_xmax
+              || layer->vw_ymin != shown->vw_ymin
+              || layer->vw_ymax != shown->vw_ymax))
+        {
+          paint_layer_moved (cr, layer, shown, &rectangle);
+          /* Place the overlays for the view now, too. */
+          PlotLayer moved = *layer;
+          moved.vw_xmin = shown->vw_xmin;
+          moved.vw_xmax = shown->vw_xmax;
+          moved.vw_ymin = shown->vw_ymin;
+          moved.vw_ymax = shown->vw_ymax;
+          draw_overlays (cr, &moved, data->pd, &rectangle);
+        }
+      else
+        {
+          cairo_set_source_surface (cr, layer->surface, rectangle.x,
+                                    rectangle.y);
+          cairo_paint (cr);
+          if (chart != LapPlot)
+            draw_overlays (cr, layer, data->pd, &rectangle);
+        }
     }
-  /* Now how much padding around the plot are we actually generating? Store it
-     for use in zooming. */
-  plgvpd (&data->pd->vw_pxmin, &data->pd->vw_pxmax, &data->pd->vw_pymin,
-          &data->pd->vw_pymax);
-  /* Close PLplot library */
-  plend ();
-  /* Reload svg to cairo context. */
-  GError **error = NULL;
-  RsvgHandle *handle = rsvg_handle_new_from_file (tmpfile, error);
-  RsvgRectangle viewport
-      = { rectangle.x, rectangle.y, rectangle.width, rectangle.height };
-  rsvg_handle_render_document (handle, cr, &viewport, error);
   /* Say: "I'm finished drawing. */
   gdk_window_end_draw_frame (window, drawingContext);
   /* Cleanup */
   cairo_region_destroy (cairoRegion);
+  log_frame_time (g_get_monotonic_time () - frame_start);
   return FALSE;
 }
 
 /* Calculate the graph ("world") x,y coordinates corresponding to the
- * GUI mouse ("device") coordinates.
+ * GUI mouse ("device") coordinates x, y.
  */
 void
-gui_to_world (struct PlotData *pd, GdkEventButton *event, enum ZoomState state)
+gui_to_world (struct PlotData *pd, gdouble x, gdouble y, enum ZoomState state)
 {
   if (pd == NULL)
     {
@@ -1411,15 +2428,15 @@ gui_to_world (struct PlotData *pd, GdkEventButton *event, enum ZoomState state)
   float left_edge, right_edge, top_edge, bottom_edge;
   /* Get the graph edges in device coordinates (e.g. pixels) */
   get_graph_edges (pd, &left_edge, &right_edge, &top_edge, &bottom_edge);
-  float fractx = (event->x - left_edge) / (right_edge - left_edge);
-  float fracty = (bottom_edge - event->y) / (bottom_edge - top_edge);
-  if (event->x < left_edge)
+  float fractx = (x - left_edge) / (right_edge - left_edge);
+  float fracty = (bottom_edge - y) / (bottom_edge - top_edge);
+  if (x < left_edge)
     fractx = 0.0;
-  if (event->x > right_edge)
+  if (x > right_edge)
     fractx = 1.0;
-  if (event->y < top_edge)
+  if (y < top_edge)
     fracty = 1.0;
-  if (event->y > bottom_edge)
+  if (y > bottom_edge)
     fracty = 0.0;
   /* Calculate the zoom limits in world coordinates. */
   if (state == Press)
@@ -1448,6 +2465,45 @@ change_cursor (GtkWidget *widget, const gchar *name)
   g_object_unref (cursor);
 }
 
+/* Input accumulated since the last frame.  Pointer motion, wheel steps and
+ * slider moves can arrive many times a frame; they are applied together on
+ * the next frame clock tick, and with nothing pending no tick is requested
+ * and nothing is redrawn.
+ */
+typedef struct PendingInput
+{
+  gboolean motion;       // a drag position is waiting
+  gdouble x, y;          // latest drag position
+  GdkModifierType state; // buttons held there
+  int scroll_steps;      // wheel steps, positive zooms in
+  gboolean scrub;        // the slider has moved
+  guint tick_id;         // the tick callback, 0 when none is installed
+} PendingInput;
+
+static PendingInput pending_input;
+
+static gboolean on_frame_tick (GtkWidget *widget, GdkFrameClock *clock,
+                               gpointer user_data);
+
+/* Have the pending input applied on the next frame. */
+static void
+request_frame (AllData *data)
+{
+  if (pending_input.tick_id == 0)
+    pending_input.tick_id = gtk_widget_add_tick_callback (
+        GTK_WIDGET (da), on_frame_tick, data, NULL);
+}
+
+/* Move the view so the point where the drag started is under the pointer. */
+static void
+pan_view (PlotData *pd)
+{
+  pd->vw_xmin = pd->vw_xmin + (pd->zm_startx - pd->zm_endx);
+  pd->vw_xmax = pd->vw_xmax + (pd->zm_startx - pd->zm_endx);
+  pd->vw_ymin = pd->vw_ymin + (pd->zm_starty - pd->zm_endy);
+  pd->vw_ymax = pd->vw_ymax + (pd->zm_starty - pd->zm_endy);
+}
+
 /* Handle mouse button press. */
 #ifdef _WIN32
 G_MODULE_EXPORT
@@ -1463,8 +2519,14 @@ on_button_press (GtkWidget *widget, GdkEvent *event, AllData *data)
     change_cursor (widget, "crosshair");
   if (buttonnum == 1)
     change_cursor (widget, "hand1");
+  /* A drag starts here, whatever was pending from the last one, and from
+   * wherever a zoom has got to.
+   */
+  pending_input.motion = FALSE;
+  stop_view_animation ();
   /* Set user selected starting x, y in world coordinates. */
-  gui_to_world (data->pd, (GdkEventButton *)event, Press);
+  gui_to_world (data->pd, ((GdkEventButton *)event)->x,
+                ((GdkEventButton *)event)->y, Press);
   return TRUE;
 }
 
@@ -1480,40 +2542,37 @@ on_button_release (GtkWidget *widget, GdkEvent *event, AllData *data)
     return FALSE;
   change_cursor (widget, "default");
   gdk_event_get_button (event, &buttonnum);
+  /* The release position supersedes any motion not yet applied. */
+  pending_input.motion = FALSE;
   /* Zoom out if right mouse button release. */
   if (buttonnum == 2)
     {
-      reset_view_limits (data->pd);
-      gtk_widget_queue_draw (GTK_WIDGET (da));
+      PlotData target = *data->pd;
+      reset_view_limits (&target);
+      animate_view (data->pd, &target);
       reset_zoom (data->pd);
       return TRUE;
     }
   /* Zoom in if left mouse button release. */
   /* Set user selected ending x, y in world coordinates. */
-  gui_to_world (data->pd, (GdkEventButton *)event, Release);
+  gui_to_world (data->pd, ((GdkEventButton *)event)->x,
+                ((GdkEventButton *)event)->y, Release);
   if ((data->pd->zm_startx != data->pd->zm_endx)
       && (data->pd->zm_starty != data->pd->zm_endy))
     {
       /* Zoom */
       if (buttonnum == 3)
         {
-          data->pd->vw_xmin = fmin (data->pd->zm_startx, data->pd->zm_endx);
-          data->pd->vw_ymin = fmin (data->pd->zm_starty, data->pd->zm_endy);
-          data->pd->vw_xmax = fmax (data->pd->zm_startx, data->pd->zm_endx);
-          data->pd->vw_ymax = fmax (data->pd->zm_starty, data->pd->zm_endy);
+          PlotData target = *data->pd;
+          target.vw_xmin = fmin (data->pd->zm_startx, data->pd->zm_endx);
+          target.vw_ymin = fmin (data->pd->zm_starty, data->pd->zm_endy);
+          target.vw_xmax = fmax (data->pd->zm_startx, data->pd->zm_endx);
+          target.vw_ymax = fmax (data->pd->zm_starty, data->pd->zm_endy);
+          animate_view (data->pd, &target);
         }
       /* Pan */
       if (buttonnum == 1)
-        {
-          data->pd->vw_xmin
-              = data->pd->vw_xmin + (data->pd->zm_startx - data->pd->zm_endx);
-          data->pd->vw_xmax
-              = data->pd->vw_xmax + (data->pd->zm_startx - data->pd->zm_endx);
-          data->pd->vw_ymin
-              = data->pd->vw_ymin + (data->pd->zm_starty - data->pd->zm_endy);
-          data->pd->vw_ymax
-              = data->pd->vw_ymax + (data->pd->zm_starty - data->pd->zm_endy);
-        }
+        pan_view (data->pd);
       gtk_widget_queue_draw (GTK_WIDGET (da));
       reset_zoom (data->pd);
     }
@@ -1521,7 +2580,8 @@ on_button_release (GtkWidget *widget, GdkEvent *event, AllData *data)
 }
 
 /* Handle mouse motion event by drawing a filled
- * polygon.
+ * polygon (right button) or panning (left button).  Only the latest
+ * position is kept; it is applied on the next frame.
  */
 #ifdef _WIN32
 G_MODULE_EXPORT
@@ -1532,31 +2592,40 @@ on_motion_notify (GtkWidget *widget, GdkEventButton *event, AllData *data)
 
   if (data->pd == NULL)
     return FALSE;
-  if (event->state & GDK_BUTTON3_MASK)
+  if (event->state & (GDK_BUTTON1_MASK | GDK_BUTTON3_MASK))
     {
-      gui_to_world (data->pd, event, Move);
-      gtk_widget_queue_draw (GTK_WIDGET (da));
-    }
-  if (event->state & GDK_BUTTON1_MASK)
-    {
-      gui_to_world (data->pd, (GdkEventButton *)event, Release);
-          data->pd->vw_xmin
-              = data->pd->vw_xmin + (data->pd->zm_startx - data->pd->zm_endx);
-          data->pd->vw_xmax
-              = data->pd->vw_xmax + (data->pd->zm_startx - data->pd->zm_endx);
-          data->pd->vw_ymin
-              = data->pd->vw_ymin + (data->pd->zm_starty - data->pd->zm_endy);
-          data->pd->vw_ymax
-              = data->pd->vw_ymax + (data->pd->zm_starty - data->pd->zm_endy);
-      gtk_widget_queue_draw (GTK_WIDGET (da));
-      while(gtk_events_pending()) gtk_main_iteration();
+      pending_input.motion = TRUE;
+      pending_input.x = event->x;
+      pending_input.y = event->y;
+      pending_input.state = event->state;
+      request_frame (data);
     }
 
   return TRUE;
 }
 
+/* Zoom the view in (positive steps) or out, 10% of each span per side per
+ * step.
+ */
+static void
+zoom_view (PlotData *pd, int steps)
+{
+  PLFLT zoomin_pct = 0.1;  //this is arbitrary between 0 and 1, could #define
+  for (; steps != 0; steps += (steps > 0) ? -1 : 1)
+    {
+      PLFLT pct = (steps > 0) ? zoomin_pct : -zoomin_pct;
+      PLFLT x_span = pd->vw_xmax - pd->vw_xmin;
+      PLFLT y_span = pd->vw_ymax - pd->vw_ymin;
+      pd->vw_xmin = pct * x_span + pd->vw_xmin;
+      pd->vw_ymin = pct * y_span + pd->vw_ymin;
+      pd->vw_xmax = -pct * x_span + pd->vw_xmax;
+      pd->vw_ymax = -pct * y_span + pd->vw_ymax;
+    }
+}
 
-/* Handle mouse scroll event by zooming. */
+/* Handle mouse scroll event by zooming.  Wheel steps are counted and
+ * applied together on the next frame.
+ */
 #ifdef _WIN32
 G_MODULE_EXPORT
 #endif
@@ -1564,23 +2633,13 @@ gboolean mouse_scroll (GtkWidget *widget,
                GdkEventScroll  *event,
                AllData *data)
                {
-  PLFLT zoomin_pct = 0.1;  //this is arbitrary between 0 and 1, could #define
-  PLFLT zoomout_pct = -zoomin_pct;
-  PLFLT x_span = data->pd->vw_xmax - data->pd->vw_xmin;
-  PLFLT y_span = data->pd->vw_ymax - data->pd->vw_ymin;
   if (event->direction == GDK_SCROLL_UP) {
-    data->pd->vw_xmin = zoomin_pct * x_span + data->pd->vw_xmin;
-    data->pd->vw_ymin = zoomin_pct * y_span + data->pd->vw_ymin; 
-    data->pd->vw_xmax = -zoomin_pct * x_span + data->pd->vw_xmax;
-    data->pd->vw_ymax = -zoomin_pct * y_span + data->pd->vw_ymax;
-    gtk_widget_queue_draw (GTK_WIDGET (da));
+    pending_input.scroll_steps++;
+    request_frame (data);
   } 
   if (event->direction == GDK_SCROLL_DOWN) {
-    data->pd->vw_xmin = zoomout_pct * x_span + data->pd->vw_xmin;
-    data->pd->vw_ymin = zoomout_pct * y_span + data->pd->vw_ymin; 
-    data->pd->vw_xmax = -zoomout_pct * x_span + data->pd->vw_xmax;
-    data->pd->vw_ymax = -zoomout_pct * y_span + data->pd->vw_ymax;
-    gtk_widget_queue_draw (GTK_WIDGET (da));
+    pending_input.scroll_steps--;
+    request_frame (data);
   }
   return TRUE;  
 }
@@ -1674,21 +2733,18 @@ mapLimits (float *min_map_lat, float *min_map_lng, float *max_map_lat,
   *min_map_lng = fminf (tl_lng, br_lng);
 }
 
-/* Calculate the center and zoom level based on the latitude
- * and longitude readings.
+/* Center the map on a range of latitude and longitude, at the closest zoom
+ * level that covers it.
  */
 void
-setCenterAndZoom (AllData *data)
+zoomToBounds (float min_lat, float min_lng, float max_lat, float max_lng)
 {
-  double center[2] = { 0.0, 0.0 };
-  float max_lat, min_lat, max_lng, min_lng;
+  double center[2] = { (max_lat + min_lat) / 2.0, (max_lng + min_lng) / 2.0 };
   float max_map_lat, min_map_lat, max_map_lng, min_map_lng;
   int min_zoom, max_zoom, zoom;
   max_zoom = osm_gps_map_source_get_max_zoom (source);
   min_zoom = osm_gps_map_source_get_min_zoom (source);
   zoom = max_zoom;
-  findCenter (data->pd->num_pts, data->pd->lat, data->pd->lng, center, &min_lat,
-              &min_lng, &max_lat, &max_lng);
   osm_gps_map_set_center_and_zoom (OSM_GPS_MAP (map), center[0], center[1],
                                    zoom);
   mapLimits (&min_map_lat, &min_map_lng, &max_map_lat, &max_map_lng);
@@ -1704,6 +2760,19 @@ setCenterAndZoom (AllData *data)
     }
 }
 
+/* Calculate the center and zoom level based on the latitude
+ * and longitude readings.
+ */
+void
+setCenterAndZoom (AllData *data)
+{
+  double center[2] = { 0.0, 0.0 };
+  float max_lat, min_lat, max_lng, min_lng;
+  findCenter (data->pd->num_pts, data->pd->lat, data->pd->lng, center, &min_lat,
+              &min_lng, &max_lat, &max_lng);
+  zoomToBounds (min_lat, min_lng, max_lat, max_lng);
+}
+
 /* Calculate the mean and standard deviation. */
 void
 stats (double *arr, int arr_size, float *mean, float *stdev)
@@ -1851,6 +2920,67 @@ update_map (AllData *data)
     }
 }
 
+/* Add records [from, to) to the map while a file is still loading.  The
+ * heat map needs the whole run's statistics, so until then the track is
+ * drawn in a single color; update_map replaces it once the load is done.
+ */
+static void
+extend_map (AllData *data, long from, long to)
+{
+  static float min_lat, min_lng, max_lat, max_lng; // of the run so far
+  if (map == NULL)
+    return;
+  if (from == 0)
+    {
+      /* A new run: clear the previous one away. */
+      osm_gps_map_track_remove_all (map);
+      if (start_track_marker != NULL)
+        osm_gps_map_image_remove (map, start_track_marker);
+      if (end_track_marker != NULL)
+        osm_gps_map_image_remove (map, end_track_marker);
+      if (posn_track_marker != NULL)
+        osm_gps_map_image_remove (map, posn_track_marker);
+      start_track_marker = NULL;
+      end_track_marker = NULL;
+      posn_track_marker = NULL;
+      min_lat = min_lng = FLT_MAX;
+      max_lat = max_lng = -FLT_MAX;
+    }
+  /* Each batch is a track of its own, handed its points whole: adding them
+   * to a track one at a time walks its list and redraws the map for every
+   * point.  It starts from the last point of the batch before, so the line
+   * is unbroken.
+   */
+  GSList *points = NULL;
+  for (long i = to - 1; i >= (from > 0 ? from - 1 : 0); i--)
+    points = g_slist_prepend (points,
+                              osm_gps_map_point_new_degrees (
+                                  data->ppace->lat[i], data->ppace->lng[i]));
+  GdkRGBA track_color;
+  gdk_rgba_parse (&track_color, "rgba( 66, 146, 198, 0.6)");
+  OsmGpsMapTrack *track = g_object_new (OSM_TYPE_GPS_MAP_TRACK, "track",
+                                        points, "line-width", TRACKWIDTH, NULL);
+  osm_gps_map_track_set_color (track, &track_color);
+  osm_gps_map_track_add (OSM_GPS_MAP (map), track);
+  g_object_unref (track);
+  /* Keep the whole of the run so far in view, taking in only the new
+   * points (the first is left out, as findCenter does).
+   */
+  for (long i = from > 1 ? from : 1; i < to; i++)
+    {
+      if (data->ppace->lat[i] < min_lat)
+        min_lat = data->ppace->lat[i];
+      if (data->ppace->lng[i] < min_lng)
+        min_lng = data->ppace->lng[i];
+      if (data->ppace->lat[i] > max_lat)
+        max_lat = data->ppace->lat[i];
+      if (data->ppace->lng[i] > max_lng)
+        max_lng = data->ppace->lng[i];
+    }
+  if (to > 1)
+    zoomToBounds (min_lat, min_lng, max_lat, max_lng);
+}
+
 /* Zoom in. */
 static void
 zoom_in (GtkWidget *widget)
@@ -1869,8 +2999,49 @@ zoom_out (GtkWidget *widget)
 // GTK GUI Stuff
 //
 
+void on_cb_session_changed (GtkComboBox *cb_Session, AllData *data);
+
+/* Offer a choice of sessions when the file holds more than one
+ * (e.g. the legs of a multisport event).
+ */
+void
+update_session_selector ()
+{
+  /* Repopulating the list must not look like a user selection. */
+  g_signal_handlers_block_matched (cb_Session, G_SIGNAL_MATCH_FUNC, 0, 0,
+                                   NULL, on_cb_session_changed, NULL);
+  gtk_combo_box_text_remove_all (cb_Session);
+  for (long i = 0; i < num_sessions; i++)
+    {
+      gchar *label = g_strdup_printf ("Session %ld", i + 1);
+      gtk_combo_box_text_append_text (cb_Session, label);
+      g_free (label);
+    }
+  gtk_combo_box_set_active (GTK_COMBO_BOX (cb_Session), session_index);
+  g_signal_handlers_unblock_matched (cb_Session, G_SIGNAL_MATCH_FUNC, 0, 0,
+                                     NULL, on_cb_session_changed, NULL);
+  gtk_widget_set_visible (GTK_WIDGET (cb_Session), num_sessions > 1);
+}
+
+/* Redraw all the widgets from the internal data structures. */
+void
+redraw_all (AllData *pall)
+{
+  /* Force a redraw on the drawing area. */
+  gtk_widget_queue_draw (GTK_WIDGET (da));
+  /* Update the session choices. */
+  update_session_selector ();
+  /* Update the summary table. */
+  update_summary (pall->psd);
+  /* Update the map. */
+  update_map (pall);
+  /* Update the slider and redraw. */
+  g_signal_emit_by_name (sc_IdxPct, "value-changed");
+}
+
 /* Convenience function to reload data, update the internal data structures
- * and redraw all the widgets.
+ * and redraw all the widgets.  The file is read in the background; the
+ * widgets are redrawn when it has been.
  */
 void
 reload_all (AllData *pall)
@@ -1878,17 +3049,28 @@ reload_all (AllData *pall)
   if ((pall != NULL) && (fname != NULL))
     {
       /* Update the plots */
-      if (init_plot_data (pall))
+      init_plot_data (pall);
+    }
+}
+
+/* As reload_all, but re-derive the display from the raw values already in
+ * memory rather than reading the file again.
+ */
+void
+reconvert_all (AllData *pall)
+{
+  /* Loaded activities always have (possibly empty) columns. */
+  if ((pall != NULL) && (pall->pact->rec_distance != NULL))
+    {
+      if (convert_plot_data (pall) != 0)
         {
-          /* Force a redraw on the drawing area. */
-          gtk_widget_queue_draw (GTK_WIDGET (da));
-          /* Update the summary table. */
-          update_summary (pall->psd);
-          /* Update the map. */
-          update_map (pall);
-          /* Update the slider and redraw. */
-          g_signal_emit_by_name (sc_IdxPct, "value-changed");
+          release_display (pall);
+          osm_gps_map_track_remove_all (map);
+          show_widgets (FALSE);
+          show_load_error (fname, "Not enough memory to display it.");
+          return;
         }
+      redraw_all (pall);
     }
 }
 
@@ -1904,7 +3086,28 @@ default_chart ()
 void
 on_cb_units_changed (GtkComboBox *cb_Units, AllData *data)
 {
-  reload_all (data);
+  /* Only the conversion factors change; the file need not be read again. */
+  reconvert_all (data);
+}
+
+/* User has chosen a different session from the file. */
+void
+on_cb_session_changed (GtkComboBox *cb_Session, AllData *data)
+{
+  gint active = gtk_combo_box_get_active (cb_Session);
+  if (active >= 0 && active != session_index)
+    {
+      session_index = active;
+      reload_all (data);
+    }
+}
+
+/* User has asked to stop the file load in progress. */
+void
+on_btn_cancel_clicked (GtkButton *btn, AllData *data)
+{
+  if (current_load != NULL)
+    activity_progress_cancel (&current_load->prog);
 }
 
 /* User has selected Pace Graph. */
@@ -1914,6 +3117,9 @@ G_MODULE_EXPORT
 void
 on_rb_pace (GtkToggleButton *togglebutton, AllData *data)
 {
+  /* Toggled fires for the button being switched off, too. */
+  if (gtk_toggle_button_get_active (togglebutton))
+    materialize_plot (data->ppace, data);
   if ((data->ppace->x != NULL) && (data->ppace->y != NULL))
     {
       data->pd = data->ppace;
@@ -1929,6 +3135,9 @@ G_MODULE_EXPORT
 void
 on_rb_cadence (GtkToggleButton *togglebutton, AllData *data)
 {
+  /* Toggled fires for the button being switched off, too. */
+  if (gtk_toggle_button_get_active (togglebutton))
+    materialize_plot (data->pcadence, data);
   if ((data->pcadence->x != NULL) && (data->pcadence->y != NULL))
     {
       data->pd = data->pcadence;
@@ -1944,6 +3153,9 @@ G_MODULE_EXPORT
 void
 on_rb_heartrate (GtkToggleButton *togglebutton, AllData *data)
 {
+  /* Toggled fires for the button being switched off, too. */
+  if (gtk_toggle_button_get_active (togglebutton))
+    materialize_plot (data->pheart, data);
   if ((data->pheart->x != NULL) && (data->pheart->y != NULL))
     {
       data->pd = data->pheart;
@@ -1959,6 +3171,9 @@ G_MODULE_EXPORT
 void
 on_rb_altitude (GtkToggleButton *togglebutton, AllData *data)
 {
+  /* Toggled fires for the button being switched off, too. */
+  if (gtk_toggle_button_get_active (togglebutton))
+    materialize_plot (data->paltitude, data);
   if ((data->paltitude->x != NULL) && (data->paltitude->y != NULL))
     {
       data->pd = data->paltitude;
@@ -1974,6 +3189,9 @@ G_MODULE_EXPORT
 void
 on_rb_splits (GtkToggleButton *togglebutton, AllData *data)
 {
+  /* Toggled fires for the button being switched off, too. */
+  if (gtk_toggle_button_get_active (togglebutton))
+    materialize_plot (data->plap, data);
   if ((data->plap->x != NULL) && (data->plap->y != NULL))
     {
       gtk_widget_queue_draw (GTK_WIDGET (da));
@@ -2002,6 +3220,11 @@ on_btnFileOpen_file_set (GtkFileChooserButton *btnFileOpen, AllData *pall)
 {
   /* fname is a global */
   fname = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (btnFileOpen));
+  /* A new file starts with its first session, and the FIT file kept
+   * decoded for switching sessions is no longer wanted.
+   */
+  session_index = 0;
+  fit_forget_file ();
   if (pall != NULL)
     reload_all (pall);
   show_widgets(TRUE); 
@@ -2011,8 +3234,8 @@ on_btnFileOpen_file_set (GtkFileChooserButton *btnFileOpen, AllData *pall)
 // Slider/Index routines.
 //
 /*
- *  Update the map, graph, and indicator label based on the
- *  slider position.
+ *  Follow the slider position.  The index is taken at once; the map, graph
+ *  and indicator label are brought up to date on the next frame.
  */
 void
 on_update_index (GtkScale *widget, AllData *data)
@@ -2023,15 +3246,22 @@ on_update_index (GtkScale *widget, AllData *data)
   gtk_adjustment_set_upper (adj, (float)data->pd->num_pts - 1.0);
   gdouble val = gtk_adjustment_get_value (adj);
   curr_idx = (int)floor (val);
-  // Redraw graph.
-  gtk_widget_queue_draw (GTK_WIDGET (da));
+  /* The value may be left over from a longer run. */
+  if (curr_idx > data->pd->num_pts - 1)
+    curr_idx = data->pd->num_pts - 1;
+  if (curr_idx < 0)
+    curr_idx = 0;
+  pending_input.scrub = TRUE;
+  request_frame (data);
+}
 
+/* Update the map marker and indicator label for the slider position. */
+static void
+update_position (AllData *data)
+{
   // Redraw the position marker on the map.
-  if ((map != NULL) && (posn_track_marker != NULL))
+  if ((map != NULL) && (posn_track_marker != NULL) && (data->pd->num_pts > 0))
     move_marker (data->pd->lat[curr_idx], data->pd->lng[curr_idx]);
-  // run the main iteration to update the GUI,
-  // in order to get it responsive and treat events from it:
-  while(gtk_events_pending()) gtk_main_iteration();
   // Update the label below the graph.
   char yval[15];
   char xval[15];
@@ -2080,6 +3310,56 @@ on_update_index (GtkScale *widget, AllData *data)
     }
 }
 
+/* Apply the input gathered since the last frame, once, then redraw.  The
+ * callback removes itself, so an idle window asks for no frames at all.
+ */
+static gboolean
+on_frame_tick (GtkWidget *widget, GdkFrameClock *clock, gpointer user_data)
+{
+  AllData *data = (AllData *)user_data;
+  PendingInput *in = &pending_input;
+  gboolean redraw = FALSE;
+  in->tick_id = 0;
+  if (in->motion && (data->pd != NULL))
+    {
+      /* Only the latest position matters for either kind of drag. */
+      if (in->state & GDK_BUTTON3_MASK)
+        gui_to_world (data->pd, in->x, in->y, Move);
+      if (in->state & GDK_BUTTON1_MASK)
+        {
+          gui_to_world (data->pd, in->x, in->y, Release);
+          pan_view (data->pd);
+          continue_gesture ();
+        }
+      redraw = TRUE;
+    }
+  in->motion = FALSE;
+  if ((in->scroll_steps != 0) && (data->pd != NULL))
+    {
+      /* Zoom on from the target of a zoom still under way. */
+      PlotData target = *data->pd;
+      if (view_anim.tick_id != 0 && view_anim.pd == data->pd)
+        {
+          target.vw_xmin = view_anim.to_xmin;
+          target.vw_xmax = view_anim.to_xmax;
+          target.vw_ymin = view_anim.to_ymin;
+          target.vw_ymax = view_anim.to_ymax;
+        }
+      zoom_view (&target, in->scroll_steps);
+      animate_view (data->pd, &target);
+    }
+  in->scroll_steps = 0;
+  if (in->scrub)
+    {
+      update_position (data);
+      redraw = TRUE;
+    }
+  in->scrub = FALSE;
+  if (redraw)
+    gtk_widget_queue_draw (GTK_WIDGET (da));
+  return G_SOURCE_REMOVE;
+}
+
 #ifdef _WIN32
 G_MODULE_EXPORT
 #endif
@@ -2105,6 +3385,11 @@ G_MODULE_EXPORT
 void
 on_window_destroy (AllData *data)
 {
+  /* The render thread closes the PLplot streams on its way out. */
+  render_stop ();
+  /* Let a load still running wind down rather than finish. */
+  if (current_load != NULL)
+    activity_progress_cancel (&current_load->prog);
   gtk_main_quit ();
 }
 
@@ -2130,6 +3415,9 @@ main (int argc, char *argv[])
   static PlotData altitudeplot;
   static PlotData lapplot;
   static SessionData sess;
+  static ActivityData activity;
+  activity_init (&activity);
+  static PlotColumns columns;
 
   paceplot.ptype = PacePlot;
   paceplot.symbol = "⏺";
@@ -2154,6 +3442,10 @@ main (int argc, char *argv[])
   paceplot.vw_pxmin = 0;
   paceplot.lat = NULL;
   paceplot.lng = NULL;
+  paceplot.xcol = NULL;
+  paceplot.latcol = NULL;
+  paceplot.lngcol = NULL;
+  paceplot.lod = NULL;
   paceplot.xaxislabel = NULL;
   paceplot.yaxislabel = NULL;
   paceplot.linecolor[0] = 156;
@@ -2161,6 +3453,8 @@ main (int argc, char *argv[])
   paceplot.linecolor[2] = 134;
   paceplot.units = English;
   paceplot.start_time = NULL;
+  paceplot.stale = FALSE;
+  paceplot.generation = 0;
 
   cadenceplot.ptype = CadencePlot;
   cadenceplot.symbol = "⏺";
@@ -2185,6 +3479,10 @@ main (int argc, char *argv[])
   cadenceplot.vw_pxmin = 0;
   cadenceplot.lat = NULL;
   cadenceplot.lng = NULL;
+  cadenceplot.xcol = NULL;
+  cadenceplot.latcol = NULL;
+  cadenceplot.lngcol = NULL;
+  cadenceplot.lod = NULL;
   cadenceplot.xaxislabel = NULL;
   cadenceplot.yaxislabel = NULL;
   cadenceplot.linecolor[0] = 31;
@@ -2192,6 +3490,8 @@ main (int argc, char *argv[])
   cadenceplot.linecolor[2] = 180;
   cadenceplot.units = English;
   cadenceplot.start_time = NULL;
+  cadenceplot.stale = FALSE;
+  cadenceplot.generation = 0;
 
   heartrateplot.ptype = HeartRatePlot;
   heartrateplot.symbol = "⏺";
@@ -2216,6 +3516,10 @@ main (int argc, char *argv[])
   heartrateplot.vw_pxmin = 0;
   heartrateplot.lat = NULL;
   heartrateplot.lng = NULL;
+  heartrateplot.xcol = NULL;
+  heartrateplot.latcol = NULL;
+  heartrateplot.lngcol = NULL;
+  heartrateplot.lod = NULL;
   heartrateplot.xaxislabel = NULL;
   heartrateplot.yaxislabel = NULL;
   heartrateplot.linecolor[0] = 255;
@@ -2223,6 +3527,8 @@ main (int argc, char *argv[])
   heartrateplot.linecolor[2] = 89;
   heartrateplot.units = English;
   heartrateplot.start_time = NULL;
+  heartrateplot.stale = FALSE;
+  heartrateplot.generation = 0;
 
   altitudeplot.ptype = AltitudePlot;
   altitudeplot.symbol = "⏺";
@@ -2247,6 +3553,10 @@ main (int argc, char *argv[])
   altitudeplot.vw_pxmin = 0;
   altitudeplot.lat = NULL;
   altitudeplot.lng = NULL;
+  altitudeplot.xcol = NULL;
+  altitudeplot.latcol = NULL;
+  altitudeplot.lngcol = NULL;
+  altitudeplot.lod = NULL;
   altitudeplot.xaxislabel = NULL;
   altitudeplot.yaxislabel = NULL;
   altitudeplot.linecolor[0] = 77;
@@ -2254,6 +3564,8 @@ main (int argc, char *argv[])
   altitudeplot.linecolor[2] = 74;
   altitudeplot.units = English;
   altitudeplot.start_time = NULL;
+  altitudeplot.stale = FALSE;
+  altitudeplot.generation = 0;
 
   lapplot.ptype = LapPlot;
   lapplot.symbol = "⏺";
@@ -2278,6 +3590,10 @@ main (int argc, char *argv[])
   lapplot.vw_pxmin = 0;
   lapplot.lat = NULL;
   lapplot.lng = NULL;
+  lapplot.xcol = NULL;
+  lapplot.latcol = NULL;
+  lapplot.lngcol = NULL;
+  lapplot.lod = NULL;
   lapplot.xaxislabel = NULL;
   lapplot.yaxislabel = NULL;
   lapplot.linecolor[0] = 255;
@@ -2285,6 +3601,8 @@ main (int argc, char *argv[])
   lapplot.linecolor[2] = 14;
   lapplot.units = English;
   lapplot.start_time = NULL;
+  lapplot.stale = FALSE;
+  lapplot.generation = 0;
 
   /* Bundle the data structures in an instance of AllData and
    * establish a pointer to it. */
@@ -2296,12 +3614,16 @@ main (int argc, char *argv[])
   allData.plap = &lapplot;
   allData.pd = &paceplot;
   allData.psd = &sess;
+  allData.pact = &activity;
+  allData.pcols = &columns;
   AllData *pall = &allData;
 
   GtkBuilder *builder;
   GtkWidget *window;
 
   gtk_init (&argc, &argv);
+  /* Files are parsed on worker threads; libxml2 must be set up first. */
+  xmlInitParser ();
 
   /* Load glade resources */
   builder = gtk_builder_new_from_resource ("/ui/siliconsneaker.glade");
@@ -2327,8 +3649,12 @@ main (int argc, char *argv[])
   btn_Zoom_Out = GTK_BUTTON (gtk_builder_get_object (builder, "btn_Zoom_Out"));
   btn_About = GTK_BUTTON (gtk_builder_get_object (builder, "btn_About"));
   cb_Units = GTK_COMBO_BOX_TEXT (gtk_builder_get_object (builder, "cb_Units"));
+  cb_Session
+      = GTK_COMBO_BOX_TEXT (gtk_builder_get_object (builder, "cb_Session"));
   sc_IdxPct = GTK_SCALE (gtk_builder_get_object (builder, "sc_IdxPct"));
   lbl_val = GTK_LABEL (gtk_builder_get_object (builder, "lbl_val"));
+  pb_Load = GTK_PROGRESS_BAR (gtk_builder_get_object (builder, "pb_Load"));
+  btn_Cancel = GTK_BUTTON (gtk_builder_get_object (builder, "btn_Cancel"));
 
   GdkPixbuf *icon;
   icon = gdk_pixbuf_new_from_resource ("/ui/siliconsneaker.png", NULL);
@@ -2377,6 +3703,10 @@ main (int argc, char *argv[])
                     GTK_WINDOW (window));
   g_signal_connect (GTK_COMBO_BOX_TEXT (cb_Units), "changed",
                     G_CALLBACK (on_cb_units_changed), pall);
+  g_signal_connect (GTK_COMBO_BOX_TEXT (cb_Session), "changed",
+                    G_CALLBACK (on_cb_session_changed), pall);
+  g_signal_connect (GTK_BUTTON (btn_Cancel), "clicked",
+                    G_CALLBACK (on_btn_cancel_clicked), pall);
   g_signal_connect (GTK_FILE_CHOOSER (btnFileOpen), "file-set",
                     G_CALLBACK (on_btnFileOpen_file_set), pall);
   g_signal_connect (GTK_SCALE (sc_IdxPct), "value-changed",
@@ -2418,6 +3748,7 @@ main (int argc, char *argv[])
   /* Display the window but show only the header bar before a file is open. */
   gtk_widget_show_all (window);
   show_widgets(FALSE); 
+  show_load_progress (FALSE);
 
   /* Process command line options. */
   int c;
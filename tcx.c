@@ -1,89 +1,229 @@
 #include <float.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 #include "tcx.h"
 
-static activity_t * current_activity = NULL;
-static lap_t * current_lap = NULL;
-static track_t * current_track = NULL;
-static trackpoint_t * current_trackpoint = NULL;
+/* libxml2's global state is set up once per process, never per parse. */
+static pthread_once_t xml_init_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Arena allocation.
+ *
+ * Memory is handed out from large blocks by bumping an offset, so building a
+ * tree of many thousands of trackpoints costs a handful of malloc calls and
+ * tearing it down costs one free per block.  Strings that repeat throughout a
+ * file (lap start times, intensities) are interned so each distinct value is
+ * stored once.
+ */
+
+#define TCX_ARENA_BLOCK_SIZE (64 * 1024)
+#define TCX_ARENA_ALIGN 16
+
+tcx_t *
+tcx_new(void)
+{
+    return calloc(1, sizeof(tcx_t));
+}
 
 void
-add_activity(tcx_t * tcx, activity_t * activity)
+tcx_free(tcx_t * tcx)
+{
+    if (tcx == NULL)
+    {
+        return;
+    }
+
+    tcx_arena_block_t * block = tcx->arena.blocks;
+    while (block != NULL)
+    {
+        tcx_arena_block_t * next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(tcx->arena.strings);
+    free(tcx);
+}
+
+void *
+tcx_alloc(tcx_t * tcx, size_t size)
+{
+    tcx_arena_block_t * block = tcx->arena.blocks;
+
+    size = (size + TCX_ARENA_ALIGN - 1) & ~((size_t)TCX_ARENA_ALIGN - 1);
+
+    if (block == NULL || block->size - block->used < size)
+    {
+        size_t block_size = size > TCX_ARENA_BLOCK_SIZE ? size : TCX_ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(tcx_arena_block_t) + block_size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->next = tcx->arena.blocks;
+        tcx->arena.blocks = block;
+    }
+
+    void * ptr = block->data + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+char *
+tcx_strdup(tcx_t * tcx, const char * string)
 {
-    if (current_activity != NULL)
+    size_t length = strlen(string) + 1;
+    char * copy = tcx_alloc(tcx, length);
+    if (copy != NULL)
     {
-        current_activity->next = activity;
+        memcpy(copy, string, length);
+    }
+    return copy;
+}
+
+static size_t
+tcx_hash(const char * string)
+{
+    size_t hash = 2166136261u;
+    while (*string)
+    {
+        hash = (hash ^ (unsigned char)*string++) * 16777619u;
+    }
+    return hash;
+}
+
+/* Return the arena's single copy of string.  The result must not be modified. */
+char *
+tcx_intern(tcx_t * tcx, const char * string)
+{
+    tcx_arena_t * arena = &tcx->arena;
+
+    if ((arena->num_strings + 1) * 2 > arena->string_capacity)
+    {
+        size_t capacity = arena->string_capacity ? arena->string_capacity * 2 : 64;
+        char ** strings = calloc(capacity, sizeof(char *));
+        if (strings == NULL)
+        {
+            return NULL;
+        }
+        for (size_t i = 0; i < arena->string_capacity; i++)
+        {
+            if (arena->strings[i] != NULL)
+            {
+                size_t j = tcx_hash(arena->strings[i]) & (capacity - 1);
+                while (strings[j] != NULL)
+                {
+                    j = (j + 1) & (capacity - 1);
+                }
+                strings[j] = arena->strings[i];
+            }
+        }
+        free(arena->strings);
+        arena->strings = strings;
+        arena->string_capacity = capacity;
+    }
+
+    size_t i = tcx_hash(string) & (arena->string_capacity - 1);
+    while (arena->strings[i] != NULL)
+    {
+        if (strcmp(arena->strings[i], string) == 0)
+        {
+            return arena->strings[i];
+        }
+        i = (i + 1) & (arena->string_capacity - 1);
+    }
+
+    arena->strings[i] = tcx_strdup(tcx, string);
+    if (arena->strings[i] != NULL)
+    {
+        arena->num_strings++;
+    }
+    return arena->strings[i];
+}
+
+void
+add_activity(tcx_parser_t * parser, activity_t * activity)
+{
+    if (parser->current_activity != NULL)
+    {
+        parser->current_activity->next = activity;
     }
     else
     {
-        tcx->activities = activity;
+        parser->tcx->activities = activity;
     }
 
-    current_activity = activity;
-    current_lap = NULL;
-    current_track = NULL;
-    current_trackpoint = NULL;
+    parser->current_activity = activity;
+    parser->current_lap = NULL;
+    parser->current_track = NULL;
+    parser->current_trackpoint = NULL;
 }
 
 void
-add_lap(lap_t * lap)
+add_lap(tcx_parser_t * parser, lap_t * lap)
 {
-    if (current_lap != NULL)
+    parser->current_activity->num_laps++;
+
+    if (parser->current_lap != NULL)
     {
-        current_lap->next = lap;
+        parser->current_lap->next = lap;
     }
     else
     {
-        current_activity->laps = lap;
+        parser->current_activity->laps = lap;
     }
 
-    current_lap = lap;
-    current_track = NULL;
-    current_trackpoint = NULL;
+    parser->current_lap = lap;
+    parser->current_track = NULL;
+    parser->current_trackpoint = NULL;
 }
 
 void
-add_track(track_t * track)
+add_track(tcx_parser_t * parser, track_t * track)
 {
-    current_lap->num_tracks++;
+    parser->current_lap->num_tracks++;
 
-    if (current_track != NULL)
+    if (parser->current_track != NULL)
     {
-        current_track->next = track;
+        parser->current_track->next = track;
     }
     else
     {
-        current_lap->tracks = track;
+        parser->current_lap->tracks = track;
     }
 
-    current_track = track;
-    current_trackpoint = NULL;
+    parser->current_track = track;
+    parser->current_trackpoint = NULL;
 }
 
 void
-add_trackpoint(trackpoint_t * trackpoint)
+add_trackpoint(tcx_parser_t * parser, trackpoint_t * trackpoint)
 {
-    current_activity->num_trackpoints++;
-    current_lap->num_trackpoints++;
-    current_track->num_trackpoints++;
+    parser->current_activity->num_trackpoints++;
+    parser->current_lap->num_trackpoints++;
+    parser->current_track->num_trackpoints++;
 
-    if (current_trackpoint != NULL)
+    if (parser->current_trackpoint != NULL)
     {
-        current_trackpoint->next = trackpoint;
+        parser->current_trackpoint->next = trackpoint;
     }
     else
     {
-        current_track->trackpoints = trackpoint;
+        parser->current_track->trackpoints = trackpoint;
     }
 
-    current_trackpoint = trackpoint;
+    parser->current_trackpoint = trackpoint;
 }
 
 int
@@ -107,14 +247,15 @@ xml_content_to_d(xmlDocPtr document, xmlNodePtr node)
 }
 
 lap_t *
-parse_lap(xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node)
+parse_lap(tcx_parser_t * parser, xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node)
 {
-    lap_t * lap = calloc(1, sizeof(lap_t));
+    tcx_t * tcx = parser->tcx;
+    lap_t * lap = tcx_alloc(tcx, sizeof(lap_t));
 
     if (xmlHasProp(node, (xmlChar*)"StartTime"))
     {
         xmlChar * content = xmlGetProp(node, (xmlChar *)"StartTime");
-        lap->start_time = strdup((const char *)content);
+        lap->start_time = tcx_intern(tcx, (const char *)content);
         xmlFree(content);
     }
 
@@ -138,7 +279,7 @@ parse_lap(xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node)
         if ((!xmlStrcmp(node->name, (const xmlChar *)"Intensity")) && (node->ns == ns))
         {
             xmlChar * content = xmlNodeListGetString(document, node->xmlChildrenNode, 1);
-            lap->intensity = strdup((const char *)content);
+            lap->intensity = tcx_intern(tcx, (const char *)content);
             xmlFree(content);
         }
 
@@ -219,16 +360,16 @@ parse_trackpoint_extensions_power_and_speed(trackpoint_t * trackpoint, xmlDocPtr
 }
 
 trackpoint_t *
-parse_trackpoint(xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node)
+parse_trackpoint(tcx_parser_t * parser, xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node)
 {
-    trackpoint_t * trackpoint = calloc(1, sizeof(trackpoint_t));
+    trackpoint_t * trackpoint = tcx_alloc(parser->tcx, sizeof(trackpoint_t));
 
     node = node->xmlChildrenNode;
     while (node != NULL) {
         if ((!xmlStrcmp(node->name, (const xmlChar *)"Time")) && (node->ns == ns))
         {
             xmlChar * content = xmlNodeListGetString(document, node->xmlChildrenNode, 1);
-            trackpoint->time = strdup((const char *)content);
+            trackpoint->time = tcx_strdup(parser->tcx, (const char *)content);
             xmlFree(content);
         }
 
@@ -271,7 +412,9 @@ parse_trackpoint(xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node)
 int
 parse_tcx_file(tcx_t * tcx, char * filename)
 {
-    xmlInitParser();
+    tcx_parser_t parser = { tcx, NULL, NULL, NULL, NULL };
+
+    pthread_once(&xml_init_once, xmlInitParser);
 
     xmlDocPtr document = xmlReadFile(filename, NULL, 0);
     if (document == NULL)
@@ -289,42 +432,38 @@ parse_tcx_file(tcx_t * tcx, char * filename)
         fprintf(stderr, "No activities found in \"%s\"\n", filename);
         xmlXPathFreeContext(context);
         xmlFreeDoc(document);
-        xmlCleanupParser();
         return 1;
     }
     else
-    {   
-        /*Bug fix CSP* current_activity is static and needs to be reinitialized if this library is not
-          unloaded from memory.*/
-        current_activity = NULL;
+    {
         for (int i = 0; i < activities->nodesetval->nodeNr; i++)
         {
-            activity_t * activity = calloc(1, sizeof(activity_t));
-            add_activity(tcx, activity);
+            activity_t * activity = tcx_alloc(tcx, sizeof(activity_t));
+            add_activity(&parser, activity);
 
             xmlNodePtr laps = activities->nodesetval->nodeTab[i]->xmlChildrenNode;
             while (laps != NULL)
             {
                 if (!xmlStrcmp(laps->name, (const xmlChar *)"Lap"))
                 {
-                    lap_t * lap = parse_lap(document, laps->ns, laps);
-                    add_lap(lap);
+                    lap_t * lap = parse_lap(&parser, document, laps->ns, laps);
+                    add_lap(&parser, lap);
 
                     xmlNodePtr tracks = laps->xmlChildrenNode;
                     while (tracks != NULL)
                     {
                         if (!xmlStrcmp(tracks->name, (const xmlChar *)"Track"))
                         {
-                            track_t * track = calloc(1, sizeof(track_t));
-                            add_track(track);
+                            track_t * track = tcx_alloc(tcx, sizeof(track_t));
+                            add_track(&parser, track);
 
                             xmlNodePtr trackpoints = tracks->xmlChildrenNode;
                             while (trackpoints != NULL)
                             {
                                 if (!xmlStrcmp(trackpoints->name, (const xmlChar *)"Trackpoint"))
                                 {
-                                    trackpoint_t * trackpoint = parse_trackpoint(document, trackpoints->ns, trackpoints);
-                                    add_trackpoint(trackpoint);
+                                    trackpoint_t * trackpoint = parse_trackpoint(&parser, document, trackpoints->ns, trackpoints);
+                                    add_trackpoint(&parser, trackpoint);
                                 }
 
                                 trackpoints = trackpoints->next;
@@ -362,11 +501,491 @@ parse_tcx_file(tcx_t * tcx, char * filename)
 
     xmlXPathFreeContext(context);
     xmlFreeDoc(document);
-    xmlCleanupParser();
 
     return 0;
 }
 
+/*
+ * Streaming parser.
+ *
+ * Rather than building the whole document in memory and querying it, walk
+ * the file once with an xmlTextReader.  Every element name is interned in
+ * the reader's dictionary, so dispatch is a pointer comparison against the
+ * names looked up once in tcx_stream_names().  Nodes are released by the
+ * reader as soon as we move past them, so memory held by libxml2 stays flat
+ * regardless of the size of the file.
+ */
+
+#define TCX_NAMESPACE "http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2"
+
+enum tcx_field
+{
+    FIELD_NONE = 0,
+    FIELD_LAP_TOTAL_TIME,
+    FIELD_LAP_DISTANCE,
+    FIELD_LAP_CALORIES,
+    FIELD_LAP_INTENSITY,
+    FIELD_TIME,
+    FIELD_LATITUDE,
+    FIELD_LONGITUDE,
+    FIELD_ELEVATION,
+    FIELD_DISTANCE,
+    FIELD_HEART_RATE,
+    FIELD_CADENCE,
+    FIELD_SPEED,
+    FIELD_POWER
+};
+
+enum tcx_group
+{
+    GROUP_NONE = 0,
+    GROUP_POSITION,
+    GROUP_HEART_RATE,
+    GROUP_EXTENSIONS,
+    GROUP_TPX
+};
+
+typedef struct tcx_names
+{
+    const xmlChar * ns;
+    const xmlChar * activity;
+    const xmlChar * lap;
+    const xmlChar * track;
+    const xmlChar * trackpoint;
+    const xmlChar * total_time;
+    const xmlChar * distance;
+    const xmlChar * calories;
+    const xmlChar * intensity;
+    const xmlChar * time;
+    const xmlChar * position;
+    const xmlChar * latitude;
+    const xmlChar * longitude;
+    const xmlChar * altitude;
+    const xmlChar * heart_rate;
+    const xmlChar * value;
+    const xmlChar * cadence;
+    const xmlChar * extensions;
+    const xmlChar * tpx;
+    const xmlChar * speed;
+    const xmlChar * watts;
+} tcx_names_t;
+
+static void
+tcx_stream_names(xmlTextReaderPtr reader, tcx_names_t * names)
+{
+    names->ns = xmlTextReaderConstString(reader, (const xmlChar *)TCX_NAMESPACE);
+    names->activity = xmlTextReaderConstString(reader, (const xmlChar *)"Activity");
+    names->lap = xmlTextReaderConstString(reader, (const xmlChar *)"Lap");
+    names->track = xmlTextReaderConstString(reader, (const xmlChar *)"Track");
+    names->trackpoint = xmlTextReaderConstString(reader, (const xmlChar *)"Trackpoint");
+    names->total_time = xmlTextReaderConstString(reader, (const xmlChar *)"TotalTimeSeconds");
+    names->distance = xmlTextReaderConstString(reader, (const xmlChar *)"DistanceMeters");
+    names->calories = xmlTextReaderConstString(reader, (const xmlChar *)"Calories");
+    names->intensity = xmlTextReaderConstString(reader, (const xmlChar *)"Intensity");
+    names->time = xmlTextReaderConstString(reader, (const xmlChar *)"Time");
+    names->position = xmlTextReaderConstString(reader, (const xmlChar *)"Position");
+    names->latitude = xmlTextReaderConstString(reader, (const xmlChar *)"LatitudeDegrees");
+    names->longitude = xmlTextReaderConstString(reader, (const xmlChar *)"LongitudeDegrees");
+    names->altitude = xmlTextReaderConstString(reader, (const xmlChar *)"AltitudeMeters");
+    names->heart_rate = xmlTextReaderConstString(reader, (const xmlChar *)"HeartRateBpm");
+    names->value = xmlTextReaderConstString(reader, (const xmlChar *)"Value");
+    names->cadence = xmlTextReaderConstString(reader, (const xmlChar *)"Cadence");
+    names->extensions = xmlTextReaderConstString(reader, (const xmlChar *)"Extensions");
+    names->tpx = xmlTextReaderConstString(reader, (const xmlChar *)"TPX");
+    names->speed = xmlTextReaderConstString(reader, (const xmlChar *)"Speed");
+    names->watts = xmlTextReaderConstString(reader, (const xmlChar *)"Watts");
+}
+
+/* Store the text content of a leaf element in the lap or trackpoint being built. */
+static void
+tcx_stream_field(tcx_t * tcx, enum tcx_field field, const char * text, lap_t * lap, trackpoint_t * trackpoint)
+{
+    switch (field)
+    {
+    case FIELD_LAP_TOTAL_TIME:
+        lap->total_time = strtod(text, NULL);
+        break;
+    case FIELD_LAP_DISTANCE:
+        lap->distance = strtod(text, NULL);
+        break;
+    case FIELD_LAP_CALORIES:
+        lap->calories = atoi(text);
+        break;
+    case FIELD_LAP_INTENSITY:
+        lap->intensity = tcx_intern(tcx, text);
+        break;
+    case FIELD_TIME:
+        trackpoint->time = tcx_strdup(tcx, text);
+        break;
+    case FIELD_LATITUDE:
+        trackpoint->latitude = strtod(text, NULL);
+        break;
+    case FIELD_LONGITUDE:
+        trackpoint->longitude = strtod(text, NULL);
+        break;
+    case FIELD_ELEVATION:
+        trackpoint->elevation = strtod(text, NULL);
+        break;
+    case FIELD_DISTANCE:
+        trackpoint->distance = strtod(text, NULL);
+        break;
+    case FIELD_HEART_RATE:
+        trackpoint->heart_rate = atoi(text);
+        break;
+    case FIELD_CADENCE:
+        trackpoint->cadence = atoi(text);
+        break;
+    case FIELD_SPEED:
+        trackpoint->speed = strtod(text, NULL);
+        break;
+    case FIELD_POWER:
+        trackpoint->power = atoi(text);
+        break;
+    case FIELD_NONE:
+        break;
+    }
+}
+
+/* Give up on a parse that has run out of memory. */
+static int
+tcx_stream_out_of_memory(xmlTextReaderPtr reader, const char * filename)
+{
+    xmlFreeTextReader(reader);
+    fprintf(stderr, "Out of memory parsing %s.\n", filename);
+    return 1;
+}
+
+/* How many reader nodes pass between progress reports. */
+#define TCX_PROGRESS_INTERVAL 4096
+
+/*
+ * Drive a reader over the whole document.  filename is only used to label
+ * diagnostics.  The reader is freed before returning.
+ */
+static int
+parse_tcx_reader(tcx_t * tcx, xmlTextReaderPtr reader, const char * filename)
+{
+    tcx_names_t names;
+    enum tcx_field field = FIELD_NONE;
+    enum tcx_group group = GROUP_NONE;
+    int activity_depth = -1;
+    int lap_depth = -1;
+    int track_depth = -1;
+    int trackpoint_depth = -1;
+    int group_depth = -1;
+    const xmlChar * lap_ns = NULL;
+    const xmlChar * trackpoint_ns = NULL;
+    activity_t * activity = NULL;
+    lap_t * lap = NULL;
+    trackpoint_t * trackpoint = NULL;
+    trackpoint_t passing;  // the point being read, when a hook takes them
+    char passing_time[64]; // its time; ISO 8601 times are far shorter
+    tcx_parser_t parser = { tcx, NULL, NULL, NULL, NULL };
+    unsigned long nodes = 0;
+    int ret;
+
+    tcx_stream_names(reader, &names);
+
+    while ((ret = xmlTextReaderRead(reader)) == 1)
+    {
+        int type = xmlTextReaderNodeType(reader);
+
+        if (tcx->progress != NULL && (++nodes % TCX_PROGRESS_INTERVAL) == 0
+            && tcx->progress(tcx->progress_data, xmlTextReaderByteConsumed(reader)) != 0)
+        {
+            xmlFreeTextReader(reader);
+            return 1;
+        }
+
+        if (type == XML_READER_TYPE_ELEMENT)
+        {
+            const xmlChar * name = xmlTextReaderConstLocalName(reader);
+            const xmlChar * ns = xmlTextReaderConstNamespaceUri(reader);
+            int depth = xmlTextReaderDepth(reader);
+            int empty = xmlTextReaderIsEmptyElement(reader);
+
+            field = FIELD_NONE;
+
+            if (trackpoint != NULL)
+            {
+                if (depth == trackpoint_depth + 1 && ns == trackpoint_ns)
+                {
+                    if (name == names.time) field = FIELD_TIME;
+                    else if (name == names.altitude) field = FIELD_ELEVATION;
+                    else if (name == names.distance) field = FIELD_DISTANCE;
+                    else if (name == names.cadence) field = FIELD_CADENCE;
+                    else if (name == names.position) group = GROUP_POSITION;
+                    else if (name == names.heart_rate) group = GROUP_HEART_RATE;
+                    else if (name == names.extensions) group = GROUP_EXTENSIONS;
+
+                    if (group != GROUP_NONE)
+                    {
+                        group_depth = depth;
+                    }
+                }
+                else if (depth == group_depth + 1)
+                {
+                    if (group == GROUP_POSITION && ns == trackpoint_ns)
+                    {
+                        if (name == names.latitude) field = FIELD_LATITUDE;
+                        else if (name == names.longitude) field = FIELD_LONGITUDE;
+                    }
+                    else if (group == GROUP_HEART_RATE && ns == trackpoint_ns)
+                    {
+                        if (name == names.value) field = FIELD_HEART_RATE;
+                    }
+                    else if (group == GROUP_EXTENSIONS && name == names.tpx)
+                    {
+                        group = GROUP_TPX;
+                        group_depth = depth;
+                    }
+                    else if (group == GROUP_TPX)
+                    {
+                        if (name == names.speed) field = FIELD_SPEED;
+                        else if (name == names.watts) field = FIELD_POWER;
+                    }
+                }
+            }
+            else if (name == names.trackpoint && track_depth >= 0)
+            {
+                if (tcx->trackpoint != NULL)
+                {
+                    /* The hook is the point's only reader, so the points are
+                     * counted but not kept, and memory stays flat. */
+                    memset(&passing, 0, sizeof(passing));
+                    trackpoint = &passing;
+                    parser.current_activity->num_trackpoints++;
+                    parser.current_lap->num_trackpoints++;
+                    parser.current_track->num_trackpoints++;
+                }
+                else
+                {
+                    trackpoint = tcx_alloc(tcx, sizeof(trackpoint_t));
+                    if (trackpoint == NULL)
+                    {
+                        return tcx_stream_out_of_memory(reader, filename);
+                    }
+                    add_trackpoint(&parser, trackpoint);
+                }
+                trackpoint_depth = depth;
+                trackpoint_ns = ns;
+            }
+            else if (name == names.track && lap != NULL)
+            {
+                track_t * track = tcx_alloc(tcx, sizeof(track_t));
+                if (track == NULL)
+                {
+                    return tcx_stream_out_of_memory(reader, filename);
+                }
+                add_track(&parser, track);
+                track_depth = depth;
+            }
+            else if (name == names.lap && activity != NULL && depth == activity_depth + 1)
+            {
+                lap = tcx_alloc(tcx, sizeof(lap_t));
+                if (lap == NULL)
+                {
+                    return tcx_stream_out_of_memory(reader, filename);
+                }
+
+                xmlChar * content = xmlTextReaderGetAttribute(reader, (const xmlChar *)"StartTime");
+                if (content != NULL)
+                {
+                    lap->start_time = tcx_intern(tcx, (const char *)content);
+                    xmlFree(content);
+                }
+
+                add_lap(&parser, lap);
+                lap_depth = depth;
+                lap_ns = ns;
+            }
+            else if (lap != NULL && track_depth < 0 && depth == lap_depth + 1 && ns == lap_ns)
+            {
+                if (name == names.total_time) field = FIELD_LAP_TOTAL_TIME;
+                else if (name == names.distance) field = FIELD_LAP_DISTANCE;
+                else if (name == names.calories) field = FIELD_LAP_CALORIES;
+                else if (name == names.intensity) field = FIELD_LAP_INTENSITY;
+            }
+            else if (name == names.activity && ns == names.ns)
+            {
+                activity = tcx_alloc(tcx, sizeof(activity_t));
+                if (activity == NULL)
+                {
+                    return tcx_stream_out_of_memory(reader, filename);
+                }
+                add_activity(&parser, activity);
+                activity_depth = depth;
+                lap = NULL;
+            }
+
+            /* Empty elements get no matching end element. */
+            if (empty)
+            {
+                field = FIELD_NONE;
+                if (depth == group_depth)
+                {
+                    group = GROUP_NONE;
+                    group_depth = -1;
+                }
+                if (depth == trackpoint_depth)
+                {
+                    if (tcx->trackpoint != NULL)
+                    {
+                        tcx->trackpoint(tcx->trackpoint_data, activity, lap, trackpoint);
+                    }
+                    trackpoint = NULL;
+                    trackpoint_depth = -1;
+                }
+                if (depth == track_depth)
+                {
+                    track_depth = -1;
+                }
+                if (depth == lap_depth)
+                {
+                    lap = NULL;
+                    lap_depth = -1;
+                }
+                if (depth == activity_depth)
+                {
+                    activity = NULL;
+                    activity_depth = -1;
+                }
+            }
+        }
+        else if (type == XML_READER_TYPE_TEXT || type == XML_READER_TYPE_CDATA)
+        {
+            if (field == FIELD_TIME && trackpoint == &passing)
+            {
+                snprintf(passing_time, sizeof(passing_time), "%s", (const char *)xmlTextReaderConstValue(reader));
+                passing.time = passing_time;
+            }
+            else if (field != FIELD_NONE)
+            {
+                tcx_stream_field(tcx, field, (const char *)xmlTextReaderConstValue(reader), lap, trackpoint);
+            }
+        }
+        else if (type == XML_READER_TYPE_END_ELEMENT)
+        {
+            int depth = xmlTextReaderDepth(reader);
+
+            field = FIELD_NONE;
+
+            if (depth == group_depth)
+            {
+                /* Leaving TPX drops back into Extensions. */
+                group = (group == GROUP_TPX) ? GROUP_EXTENSIONS : GROUP_NONE;
+                group_depth = (group == GROUP_EXTENSIONS) ? trackpoint_depth + 1 : -1;
+            }
+            else if (depth == trackpoint_depth)
+            {
+                if (tcx->trackpoint != NULL)
+                {
+                    tcx->trackpoint(tcx->trackpoint_data, activity, lap, trackpoint);
+                }
+                trackpoint = NULL;
+                trackpoint_depth = -1;
+            }
+            else if (depth == track_depth)
+            {
+                track_depth = -1;
+            }
+            else if (depth == lap_depth)
+            {
+                lap = NULL;
+                lap_depth = -1;
+            }
+            else if (depth == activity_depth)
+            {
+                /* Laps outside an activity, as in <Courses>, are not its. */
+                activity = NULL;
+                activity_depth = -1;
+            }
+        }
+    }
+
+    xmlFreeTextReader(reader);
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "Could not parse %s.\n", filename);
+        return 1;
+    }
+
+    if (tcx->activities == NULL)
+    {
+        fprintf(stderr, "No activities found in \"%s\"\n", filename);
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+parse_tcx_file_streaming(tcx_t * tcx, char * filename)
+{
+    pthread_once(&xml_init_once, xmlInitParser);
+
+    xmlTextReaderPtr reader = xmlReaderForFile(filename, NULL, 0);
+    if (reader == NULL)
+    {
+        fprintf(stderr, "Could not parse %s.\n", filename);
+        return 1;
+    }
+
+    return parse_tcx_reader(tcx, reader, filename);
+}
+
+/* A caller-owned buffer, handed to a reader a piece at a time. */
+typedef struct tcx_memory_input
+{
+    const char * next;
+    size_t left;
+} tcx_memory_input_t;
+
+static int
+tcx_memory_read(void * context, char * buffer, int len)
+{
+    tcx_memory_input_t * input = context;
+    size_t n = input->left < (size_t)len ? input->left : (size_t)len;
+
+    memcpy(buffer, input->next, n);
+    input->next += n;
+    input->left -= n;
+    return (int)n;
+}
+
+/*
+ * As parse_tcx_file_streaming(), but reads from a caller-owned buffer (for
+ * example a mapped file) which must stay valid until this returns.  Strings
+ * kept in the tree are copied into the arena, never pointed into the buffer.
+ */
+int
+parse_tcx_memory_streaming(tcx_t * tcx, const char * buffer, size_t size, const char * filename)
+{
+    tcx_memory_input_t input = { buffer, size };
+    xmlTextReaderPtr reader;
+
+    pthread_once(&xml_init_once, xmlInitParser);
+
+    /* libxml2 takes a whole buffer only up to INT_MAX bytes; past that it
+     * is read through the same callbacks as any other stream. */
+    if (size <= INT_MAX)
+    {
+        reader = xmlReaderForMemory(buffer, (int)size, filename, NULL, 0);
+    }
+    else
+    {
+        reader = xmlReaderForIO(tcx_memory_read, NULL, &input, filename, NULL, 0);
+    }
+    if (reader == NULL)
+    {
+        fprintf(stderr, "Could not parse %s.\n", filename);
+        return 1;
+    }
+
+    return parse_tcx_reader(tcx, reader, filename);
+}
+
 double
 interval_distance(trackpoint_t * previous_trackpoint, trackpoint_t * trackpoint)
 {
@@ -378,18 +997,10 @@ interval_distance(trackpoint_t * previous_trackpoint, trackpoint_t * trackpoint)
     }
     else
     {
-        coordinates_t * start = calloc(1, sizeof(coordinates_t));
-        coordinates_t * end = calloc(1, sizeof(coordinates_t));
+        coordinates_t start = { previous_trackpoint->latitude, previous_trackpoint->longitude };
+        coordinates_t end = { trackpoint->latitude, trackpoint->longitude };
 
-        start->latitude = previous_trackpoint->latitude;
-        start->longitude = previous_trackpoint->longitude;
-        end->latitude = trackpoint->latitude;
-        end->longitude = trackpoint->longitude;
-
-        distance = haversine_distance(start, end);
-
-        free(start);
-        free(end);
+        distance = haversine_distance(&start, &end);
     }
 
     return distance;
@@ -505,18 +1116,22 @@ calculate_summary_activity(activity_t * activity, lap_t * lap)
 }
 
 void
-calculate_summary_lap(activity_t * activity, lap_t * lap, trackpoint_t * trackpoint)
+calculate_summary_lap(tcx_t * tcx, activity_t * activity, lap_t * lap, trackpoint_t * trackpoint)
 {
+    /* Should the arena run out, the points are left unset. */
     if (activity->start_point == NULL)
     {
-        activity->start_point = calloc(1, sizeof(coordinates_t));
-        activity->start_point->latitude = trackpoint->latitude;
-        activity->start_point->longitude = trackpoint->longitude;
+        activity->start_point = tcx_alloc(tcx, sizeof(coordinates_t));
+        if (activity->start_point != NULL)
+        {
+            activity->start_point->latitude = trackpoint->latitude;
+            activity->start_point->longitude = trackpoint->longitude;
+        }
     }
 
     if (activity->end_point == NULL)
     {
-        activity->end_point = calloc(1, sizeof(coordinates_t));
+        activity->end_point = tcx_alloc(tcx, sizeof(coordinates_t));
     }
     else
     {
@@ -577,6 +1192,74 @@ calculate_summary_lap(activity_t * activity, lap_t * lap, trackpoint_t * trackpo
     activity->speed_average += trackpoint->speed;
 }
 
+void
+calculate_summary_activity_begin(activity_t * activity)
+{
+    activity->cadence_maximum = INT_MIN;
+    activity->cadence_minimum = INT_MAX;
+    activity->elevation_maximum = DBL_MIN;
+    activity->elevation_minimum = DBL_MAX;
+    activity->heart_rate_maximum = INT_MIN;
+    activity->heart_rate_minimum = INT_MAX;
+    activity->speed_maximum = DBL_MIN;
+    activity->speed_minimum = DBL_MAX;
+}
+
+void
+calculate_summary_activity_end(activity_t * activity)
+{
+    if (activity->num_trackpoints > 0)
+    {
+        activity->cadence_average /= activity->num_trackpoints;
+        activity->heart_rate_average /= activity->num_trackpoints;
+        activity->speed_average /= activity->num_trackpoints;
+    }
+
+    if (activity->cadence_maximum == INT_MIN) activity->cadence_maximum = 0;
+    if (activity->cadence_minimum == INT_MAX) activity->cadence_minimum = 0;
+    if (activity->heart_rate_maximum == INT_MIN) activity->heart_rate_maximum = 0;
+    if (activity->heart_rate_minimum == INT_MAX) activity->heart_rate_minimum = 0;
+    if (activity->speed_maximum == DBL_MIN) activity->speed_maximum = 0.0;
+    if (activity->speed_minimum == DBL_MAX) activity->speed_minimum = 0.0;
+    if (activity->elevation_maximum == DBL_MIN) activity->elevation_maximum = 0.0;
+    if (activity->elevation_minimum == DBL_MAX) activity-> elevation_minimum = 0.0;
+}
+
+void
+calculate_summary_lap_begin(lap_t * lap)
+{
+    lap->cadence_maximum = INT_MIN;
+    lap->cadence_minimum = INT_MAX;
+    lap->elevation_maximum = DBL_MIN;
+    lap->elevation_minimum = DBL_MAX;
+    lap->heart_rate_maximum = INT_MIN;
+    lap->heart_rate_minimum = INT_MAX;
+    lap->speed_maximum = DBL_MIN;
+    lap->speed_minimum = DBL_MAX;
+}
+
+void
+calculate_summary_lap_end(activity_t * activity, lap_t * lap)
+{
+    if (lap->num_trackpoints > 0)
+    {
+        lap->cadence_average /= lap->num_trackpoints;
+        lap->heart_rate_average /= lap->num_trackpoints;
+        lap->speed_average /= lap->num_trackpoints;
+    }
+
+    calculate_grade_adjusted_time(lap);
+
+    if (lap->cadence_maximum == INT_MIN) lap->cadence_maximum = 0;
+    if (lap->cadence_minimum == INT_MAX) lap->cadence_minimum = 0;
+    if (lap->heart_rate_maximum == INT_MIN) lap->heart_rate_maximum = 0;
+    if (lap->heart_rate_minimum == INT_MAX) lap->heart_rate_minimum = 0;
+    if (lap->speed_maximum == DBL_MIN) lap->speed_maximum = 0.0;
+    if (lap->speed_minimum == DBL_MAX) lap->speed_minimum = 0.0;
+
+    calculate_summary_activity(activity, lap);
+}
+
 void
 calculate_summary(tcx_t * tcx)
 {
@@ -589,26 +1272,12 @@ calculate_summary(tcx_t * tcx)
     activity = tcx->activities;
     while (activity != NULL)
     {
-        activity->cadence_maximum = INT_MIN;
-        activity->cadence_minimum = INT_MAX;
-        activity->elevation_maximum = DBL_MIN;
-        activity->elevation_minimum = DBL_MAX;
-        activity->heart_rate_maximum = INT_MIN;
-        activity->heart_rate_minimum = INT_MAX;
-        activity->speed_maximum = DBL_MIN;
-        activity->speed_minimum = DBL_MAX;
+        calculate_summary_activity_begin(activity);
 
         lap = activity->laps;
         while (lap != NULL)
         {
-            lap->cadence_maximum = INT_MIN;
-            lap->cadence_minimum = INT_MAX;
-            lap->elevation_maximum = DBL_MIN;
-            lap->elevation_minimum = DBL_MAX;
-            lap->heart_rate_maximum = INT_MIN;
-            lap->heart_rate_minimum = INT_MAX;
-            lap->speed_maximum = DBL_MIN;
-            lap->speed_minimum = DBL_MAX;
+            calculate_summary_lap_begin(lap);
 
             track = lap->tracks;
             while (track != NULL)
@@ -616,7 +1285,7 @@ calculate_summary(tcx_t * tcx)
                 trackpoint = track->trackpoints;
                 while (trackpoint != NULL)
                 {
-                    calculate_summary_lap(activity, lap, trackpoint);
+                    calculate_summary_lap(tcx, activity, lap, trackpoint);
 
                     if (previous_trackpoint != NULL)
                     {
@@ -628,54 +1297,18 @@ calculate_summary(tcx_t * tcx)
                     trackpoint = trackpoint->next;
                 }
 
-                lap->cadence_average /= lap->num_trackpoints;
-                lap->heart_rate_average /= lap->num_trackpoints;
-                lap->speed_average /= lap->num_trackpoints;
-
-                if (lap->cadence_maximum == INT_MIN) lap->cadence_maximum = 0;
-                if (lap->cadence_minimum == INT_MAX) lap->cadence_minimum = 0;
-                if (lap->heart_rate_maximum == INT_MIN) lap->heart_rate_maximum = 0;
-                if (lap->heart_rate_minimum == INT_MAX) lap->heart_rate_minimum = 0;
-                if (lap->speed_maximum == DBL_MIN) lap->speed_maximum = 0.0;
-                if (lap->speed_minimum == DBL_MAX) lap->speed_minimum = 0.0;
-
                 track = track->next;
             }
 
-            calculate_grade_adjusted_time(lap);
-
-            if (lap->cadence_maximum == INT_MIN) lap->cadence_maximum = 0;
-            if (lap->cadence_minimum == INT_MAX) lap->cadence_minimum = 0;
-            if (lap->heart_rate_maximum == INT_MIN) lap->heart_rate_maximum = 0;
-            if (lap->heart_rate_minimum == INT_MAX) lap->heart_rate_minimum = 0;
-            if (lap->speed_maximum == DBL_MIN) lap->speed_maximum = 0.0;
-            if (lap->speed_minimum == DBL_MAX) lap->speed_minimum = 0.0;
-
-            calculate_summary_activity(activity, lap);
+            calculate_summary_lap_end(activity, lap);
 
             lap = lap->next;
         }
 
-        activity->cadence_average /= activity->num_trackpoints;
-        activity->heart_rate_average /= activity->num_trackpoints;
-        activity->speed_average /= activity->num_trackpoints;
-
-        if (activity->cadence_maximum == INT_MIN) activity->cadence_maximum = 0;
-        if (activity->cadence_minimum == INT_MAX) activity->cadence_minimum = 0;
-        if (activity->heart_rate_maximum == INT_MIN) activity->heart_rate_maximum = 0;
-        if (activity->heart_rate_minimum == INT_MAX) activity->heart_rate_minimum = 0;
-        if (activity->speed_maximum == DBL_MIN) activity->speed_maximum = 0.0;
-        if (activity->speed_minimum == DBL_MAX) activity->speed_minimum = 0.0;
-        if (activity->elevation_maximum == DBL_MIN) activity->elevation_maximum = 0.0;
-        if (activity->elevation_minimum == DBL_MAX) activity-> elevation_minimum = 0.0;
+        calculate_summary_activity_end(activity);
 
         activity = activity->next;
     }
-
-    free(trackpoint);
-    free(track);
-    free(lap);
-    free(activity);
 }
 
 void
@@ -789,9 +1422,4 @@ print_tcx(tcx_t * tcx)
 
         activity = activity->next;
     }
-
-    free(trackpoint);
-    free(track);
-    free(lap);
-    free(activity);
 }
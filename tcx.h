@@ -91,28 +91,87 @@ typedef struct activity
     struct activity * next;
 } activity_t;
 
+/*
+ * Every structure and string hanging off a tcx_t is carved out of a per-parse
+ * arena so that the whole tree can be released with a single tcx_free().
+ */
+typedef struct tcx_arena_block
+{
+    struct tcx_arena_block * next;
+    size_t size;
+    size_t used;
+    char data[];
+} tcx_arena_block_t;
+
+typedef struct tcx_arena
+{
+    tcx_arena_block_t * blocks;
+    char ** strings; // open-addressed table of interned strings
+    size_t num_strings;
+    size_t string_capacity;
+} tcx_arena_t;
+
 typedef struct
 {
     activity_t * activities;
+    tcx_arena_t arena;
+    /*
+     * Optional.  Called every so often during a parse with the number of
+     * input bytes consumed so far; a nonzero return abandons the parse.
+     */
+    int (* progress)(void * data, long consumed);
+    void * progress_data;
+    /*
+     * Optional.  Called by the streaming parsers as each <Trackpoint> element
+     * closes, with the point and the activity and lap it belongs to, so that
+     * the points can be used while the rest of the file is still being read.
+     * The points are not kept: each one, and its time, is only valid during
+     * the call, and the tracks are left empty but for their counts.  The
+     * summary fields are not filled in; a hook that wants them can build
+     * them up with the calculate_summary_*() steps as the points go by.
+     */
+    void (* trackpoint)(void * data, activity_t * activity, lap_t * lap, trackpoint_t * trackpoint);
+    void * trackpoint_data;
 } tcx_t;
 
-void add_activity(tcx_t * tcx, activity_t * activity);
-void add_lap(lap_t * lap);
-void add_track(track_t * track);
-void add_trackpoint(trackpoint_t * trackpoint);
+tcx_t * tcx_new(void);
+void tcx_free(tcx_t * tcx);
+void * tcx_alloc(tcx_t * tcx, size_t size);
+char * tcx_strdup(tcx_t * tcx, const char * string);
+char * tcx_intern(tcx_t * tcx, const char * string);
+
+/*
+ * State for a single parse.  Each parse owns its own context, so any number
+ * of files may be parsed concurrently from different threads.
+ */
+typedef struct tcx_parser
+{
+    tcx_t * tcx;
+    activity_t * current_activity;
+    lap_t * current_lap;
+    track_t * current_track;
+    trackpoint_t * current_trackpoint;
+} tcx_parser_t;
+
+void add_activity(tcx_parser_t * parser, activity_t * activity);
+void add_lap(tcx_parser_t * parser, lap_t * lap);
+void add_track(tcx_parser_t * parser, track_t * track);
+void add_trackpoint(tcx_parser_t * parser, trackpoint_t * trackpoint);
 
 int xml_content_to_i(xmlDocPtr document, xmlNodePtr node);
 double xml_content_to_d(xmlDocPtr document, xmlNodePtr node);
 
-lap_t * parse_lap(xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node);
+lap_t * parse_lap(tcx_parser_t * parser, xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node);
 
 void parse_trackpoint_coordinates(trackpoint_t * trackpoint, xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node);
 void parse_trackpoint_heart_beat(trackpoint_t * trackpoint, xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node);
 void parse_trackpoint_extensions(trackpoint_t * trackpoint, xmlDocPtr document, xmlNodePtr node);
 void parse_trackpoint_extensions_power_and_speed(trackpoint_t * trackpoint, xmlDocPtr document, xmlNodePtr node);
-trackpoint_t * parse_trackpoint(xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node);
+trackpoint_t * parse_trackpoint(tcx_parser_t * parser, xmlDocPtr document, xmlNsPtr ns, xmlNodePtr node);
 
 int parse_tcx_file(tcx_t * tcx, char * filename);
+int parse_tcx_file_streaming(tcx_t * tcx, char * filename);
+int parse_tcx_memory_streaming(tcx_t * tcx, const char * buffer, size_t size, const char * filename);
 
 double interval_distance(trackpoint_t * previous_trackpoint, trackpoint_t * trackpoint);
 double haversine_distance(coordinates_t * start, coordinates_t * end);
@@ -121,7 +180,11 @@ void calculate_grade(trackpoint_t * previous_trackpoint, trackpoint_t * trackpoi
 void calculate_grade_adjusted_time(lap_t * lap);
 void calculate_elevation_delta(lap_t * lap, trackpoint_t * previous_trackpoint, trackpoint_t * trackpoint);
 void calculate_summary_activity(activity_t * activity, lap_t * lap);
-void calculate_summary_lap(activity_t * activity, lap_t * lap, trackpoint_t * trackpoint);
+void calculate_summary_activity_begin(activity_t * activity);
+void calculate_summary_activity_end(activity_t * activity);
+void calculate_summary_lap_begin(lap_t * lap);
+void calculate_summary_lap_end(activity_t * activity, lap_t * lap);
+void calculate_summary_lap(tcx_t * tcx, activity_t * activity, lap_t * lap, trackpoint_t * trackpoint);
 void calculate_summary(tcx_t * tcx);
 
 void print_activity(activity_t * activity);
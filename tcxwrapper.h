@@ -1,4 +1,6 @@
+#include "activity.h"
 #include "tcx.h"
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,266 +9,430 @@
 #include <unistd.h>
 #define ZERO_THRESHOLD 0.1
 
-/* Return type for parse_fit_file */
-typedef struct result_type
+/* The calendar day most recently seen by parseiso8601.  Trackpoints arrive in
+ * order, so nearly every timestamp falls on the same day as the one before it
+ * and only the time of day needs decoding.
+ */
+typedef struct iso8601_cache
 {
-  long int failed;
-  float *prec_distance;
-  float *prec_speed;
-  float *prec_altitude;
-  float *prec_cadence;
-  float *prec_heartrate;
-  float *prec_lat;
-  float *prec_long;
-  float *plap_total_distance;
-  float *plap_start_position_lat;
-  float *plap_start_position_long;
-  float *plap_total_elapsed_time;
-  long int nRecs;
-  long int nLaps;
-  time_t time_zone_offset;
-  time_t sess_timestamp;
-  time_t sess_start_time;
-  float sess_start_position_lat;
-  float sess_start_position_long;
-  float sess_total_elapsed_time;
-  float sess_total_timer_time;
-  float sess_total_distance;
-  float sess_nec_latitude;
-  float sess_nec_longitude;
-  float sess_swc_latitude;
-  float sess_swc_longitude;
-  float sess_total_work;
-  float sess_total_moving_time;
-  float sess_average_lap_time;
-  float sess_total_calories;
-  float sess_avg_speed;
-  float sess_max_speed;
-  float sess_total_ascent;
-  float sess_total_descent;
-  float sess_avg_altitude;
-  float sess_max_altitude;
-  float sess_min_altitude;
-  float sess_avg_heartrate;
-  float sess_max_heartrate;
-  float sess_min_heartrate;
-  float sess_avg_cadence;
-  float sess_max_cadence;
-  float sess_avg_temperature;
-  float sess_max_temperature;
-  float sess_total_anaerobic_training_effect;
-} result_type;
+  int year;
+  int month;
+  int day;
+  double day_base; // seconds since the epoch at 00:00:00Z on that day
+} iso8601_cache_t;
 
-/*  parses only YYYY-MM-DDTHH:MM:SSZ */
+/* Days from 1970-01-01 to the given proleptic Gregorian date. */
+static long
+days_from_civil (int y, int m, int d)
+{
+  y -= m <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  long yoe = y - era * 400;
+  long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/* Read exactly n decimal digits, or return -1. */
+static int
+iso8601_digits (const char *p, int n)
+{
+  int v = 0;
+  for (int i = 0; i < n; i++)
+    {
+      if (p[i] < '0' || p[i] > '9')
+        return -1;
+      v = v * 10 + (p[i] - '0');
+    }
+  return v;
+}
+
+/*  parses YYYY-MM-DDTHH:MM:SS[.fff][Z|+HH:MM|-HH:MM|+HHMM|+HH] into seconds
+ *  since the epoch, keeping fractional seconds.  A missing suffix is taken as
+ *  UTC.  cache may be NULL.  Returns NAN if the string is not in that form.
+ */
+double
+parseiso8601 (const char *date, iso8601_cache_t *cache)
+{
+  iso8601_cache_t local = { 0 };
+  if (date == NULL)
+    return NAN;
+  if (cache == NULL)
+    cache = &local;
+  /* Check the separators, and with them the length, before reading any
+   * field past them, so a truncated value is never read beyond its end.
+   */
+  if (strnlen (date, 19) < 19 || date[4] != '-' || date[7] != '-'
+      || (date[10] != 'T' && date[10] != 't' && date[10] != ' ')
+      || date[13] != ':' || date[16] != ':')
+    return NAN;
+  int year = iso8601_digits (date, 4);
+  int month = iso8601_digits (date + 5, 2);
+  int day = iso8601_digits (date + 8, 2);
+  if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31)
+    return NAN;
+  int hour = iso8601_digits (date + 11, 2);
+  int min = iso8601_digits (date + 14, 2);
+  int sec = iso8601_digits (date + 17, 2);
+  if (hour < 0 || min < 0 || sec < 0)
+    return NAN;
+  const char *p = date + 19;
+  double frac = 0.0;
+  if (*p == '.' || *p == ',')
+    {
+      double scale = 0.1;
+      p++;
+      while (*p >= '0' && *p <= '9')
+        {
+          frac += (*p - '0') * scale;
+          scale *= 0.1;
+          p++;
+        }
+    }
+  int offset = 0;
+  if (*p == '+' || *p == '-')
+    {
+      int sign = (*p == '+') ? 1 : -1;
+      int oh = iso8601_digits (p + 1, 2);
+      int om = 0;
+      if (oh < 0)
+        return NAN;
+      if (p[3] == ':')
+        om = iso8601_digits (p + 4, 2);
+      else if (p[3] >= '0' && p[3] <= '9')
+        om = iso8601_digits (p + 3, 2);
+      if (om < 0)
+        return NAN;
+      offset = sign * (oh * 3600 + om * 60);
+    }
+  /* Only a new day costs the calendar arithmetic. */
+  if (year != cache->year || month != cache->month || day != cache->day)
+    {
+      cache->year = year;
+      cache->month = month;
+      cache->day = day;
+      cache->day_base = days_from_civil (year, month, day) * 86400.0;
+    }
+  return cache->day_base + (hour * 3600 + min * 60 + sec - offset) + frac;
+}
+
+/*  parses an ISO-8601 timestamp to whole seconds since the epoch, or -1 */
 time_t
 parseiso8601utc (const char *date)
 {
-  struct tm tt = { 0 };
-  double seconds;
-  if (sscanf (date, "%04d-%02d-%02dT%02d:%02d:%lfZ", &tt.tm_year, &tt.tm_mon,
-              &tt.tm_mday, &tt.tm_hour, &tt.tm_min, &seconds)
-      != 6)
+  double t = parseiso8601 (date, NULL);
+  if (isnan (t))
     return -1;
-  tt.tm_sec = (int)seconds;
-  tt.tm_mon -= 1;
-  tt.tm_year -= 1900;
-  // tt.tm_isdst = -1;
-  tt.tm_isdst = 0;
-  return mktime (&tt) - timezone;
+  return (time_t)floor (t);
 }
 
-int
-create_arrays_from_tcx_file (char *fname, int NSIZE, int LSIZE, result_type *r)
+/* State carried through the parse while the columns are filled. */
+typedef struct tcx_columns
 {
-  activity_t *activity = NULL;
-  lap_t *lap = NULL;
-  track_t *track = NULL;
-  trackpoint_t *trackpoint = NULL;
+  ActivityData *r;
+  tcx_t *tcx;
+  long session;         // only this activity's points are converted
+  activity_t *selected; // which is this one, once the parse reaches it
+  iso8601_cache_t day_cache;
+  double prev_timestamp;
+  float prev_distance;
+  lap_t *prev_lap;
+  trackpoint_t prev_point; // a copy, for the elevation gain and loss
+  long npoints;            // of the activity, bad GPS readings included
+  double ended_at;         // the time of its last point
+  long j;        // next record
+  long k;        // next lap
+  long max_recs; // room in the record columns
+  long max_laps; // and in the lap columns
+  int overflow;  // set if the file held more than there was room for
+  ActivityProgress *prog; // where finished records are published
+} tcx_columns_t;
 
-  /* Grab some memory to store the results. */
-  r->prec_distance = (float *)malloc (NSIZE * sizeof (float));
-  r->prec_speed = (float *)malloc (NSIZE * sizeof (float));
-  r->prec_altitude = (float *)malloc (NSIZE * sizeof (float));
-  r->prec_cadence = (float *)malloc (NSIZE * sizeof (float));
-  r->prec_heartrate = (float *)malloc (NSIZE * sizeof (float));
-  r->prec_lat = (float *)malloc (NSIZE * sizeof (float));
-  r->prec_long = (float *)malloc (NSIZE * sizeof (float));
-  r->plap_total_distance = (float *)malloc (LSIZE * sizeof (float));
-  r->plap_start_position_lat = (float *)malloc (LSIZE * sizeof (float));
-  r->plap_start_position_long = (float *)malloc (LSIZE * sizeof (float));
-  r->plap_total_elapsed_time = (float *)malloc (LSIZE * sizeof (float));
-  r->nRecs = 0;
-  r->nLaps = 0;
-  r->time_zone_offset = 0;
-  r->sess_timestamp = 0;
-  r->sess_start_time = 0;
-  r->sess_start_position_lat = NAN;
-  r->sess_start_position_long = NAN;
-  r->sess_total_elapsed_time = NAN;
-  r->sess_total_timer_time = NAN;
-  r->sess_total_distance = NAN;
-  r->sess_nec_latitude = NAN;
-  r->sess_nec_longitude = NAN;
-  r->sess_swc_latitude = NAN;
-  r->sess_swc_longitude = NAN;
-  r->sess_total_work = NAN;
-  r->sess_total_moving_time = NAN;
-  r->sess_average_lap_time = NAN;
-  r->sess_total_calories = NAN;
-  r->sess_avg_speed = NAN;
-  r->sess_max_speed = NAN;
-  r->sess_total_ascent = NAN;
-  r->sess_total_descent = NAN;
-  r->sess_avg_altitude = NAN;
-  r->sess_max_altitude = NAN;
-  r->sess_min_altitude = NAN;
-  r->sess_avg_heartrate = NAN;
-  r->sess_max_heartrate = NAN;
-  r->sess_min_heartrate = NAN;
-  r->sess_avg_cadence = NAN;
-  r->sess_max_cadence = NAN;
-  r->sess_avg_temperature = NAN;
-  r->sess_max_temperature = NAN;
-  r->sess_total_anaerobic_training_effect = NAN;
+/* Records are published for display in runs of this many. */
+#define TCX_PUBLISH_INTERVAL 4096
 
-  tcx_t *tcx = calloc (1, sizeof (tcx_t));
+/* Called by the parser as each trackpoint closes, in file order. */
+static void
+tcx_fill_columns (void *data, activity_t *activity, lap_t *lap,
+                  trackpoint_t *trackpoint)
+{
+  tcx_columns_t *c = (tcx_columns_t *)data;
+  ActivityData *r = c->r;
+  long j = c->j;
+  double timestamp;
 
-  if (parse_tcx_file (tcx, fname) == 0)
+  /* The session's activity is the session'th one the parse has begun. */
+  if (c->selected == NULL)
     {
-      /* Calculate derived values. */
-      calculate_summary (tcx);
-
-      /* Calculate the actual size of the results. */
-      activity = tcx->activities;
-      /* Walk the linked list to get the number of points. */
-      while (activity != NULL)
+      activity_t *a = c->tcx->activities;
+      for (long i = 0; a != NULL && i < c->session; i++)
         {
-          lap = activity->laps;
-          while (lap != NULL)
-            {
-              track = lap->tracks;
-              while (track != NULL)
-                {
-                  r->nRecs = r->nRecs + track->num_trackpoints;
-                  trackpoint = track->trackpoints;
-                  while (trackpoint != NULL)
-                    {
-                      trackpoint = trackpoint->next;
-                    }
-                  track = track->next;
-                }
-              r->nLaps = r->nLaps + 1;
-              lap = lap->next;
-            }
-          activity = activity->next;
+          a = a->next;
         }
+      c->selected = a;
+    }
+  if (activity != c->selected)
+    return;
 
-      /* Convert the linked lists to arrays. */
-      long int prev_timestamp = 0;
-      float prev_distance = 0.0;
-      time_t timestamp;
-      r->sess_max_speed = 0.0;
-      activity = tcx->activities;
-      int j = 0;
-      int k = 0;
-      while (activity != NULL)
+  /* The first point of each lap supplies the lap's start position; its
+   * time and distance are filled in once the whole lap has been read. */
+  if (lap != c->prev_lap)
+    {
+      if (c->prev_lap == NULL)
+        calculate_summary_activity_begin (activity);
+      calculate_summary_lap_begin (lap);
+      c->prev_lap = lap;
+      if (c->k == c->max_laps)
         {
-          lap = activity->laps;
-          while (lap != NULL)
-            {
-              track = lap->tracks;
-              while (track != NULL)
-                {
-                  trackpoint = track->trackpoints;
-                  while (trackpoint != NULL)
-                    {
-                      /* Check for "bad" GPS readings.  You don't run off the
-                       * coast of Africa. */
-                      if (!(trackpoint->latitude >= -ZERO_THRESHOLD
-                            && trackpoint->latitude <= ZERO_THRESHOLD)
-                          && !(trackpoint->longitude >= -ZERO_THRESHOLD
-                               && trackpoint->longitude <= ZERO_THRESHOLD))
-                        {
-                          timestamp = parseiso8601utc (trackpoint->time);
-                          r->prec_distance[j] = (float)trackpoint->distance;
-                          if (timestamp && prev_timestamp)
-                            {
-                              r->prec_speed[j] = ((float)trackpoint->distance
-                                                  - prev_distance)
-                                                 / ((double)timestamp
-                                                    - (double)prev_timestamp);
-                            }
-                          else
-                            {
-                              if (j > 0)
-                                {
-                                  r->prec_speed[j] = r->prec_speed[j - 1];
-                                }
-                              else
-                                {
-                                  r->prec_speed[j] = 1.0; // dummy one up?
-                                }
-                            }
-                          if (r->prec_speed[j] > r->sess_max_speed) {
-                            r->sess_max_speed = r->prec_speed[j];
-                          }
-                          r->prec_altitude[j] = (float)trackpoint->elevation;
-                          r->prec_cadence[j] = (float)trackpoint->cadence;
-                          r->prec_heartrate[j] = (float)trackpoint->heart_rate;
-                          r->prec_lat[j] = (float)trackpoint->latitude;
-                          r->prec_long[j] = (float)trackpoint->longitude;
-                          prev_timestamp = timestamp;
-                          prev_distance = r->prec_distance[j];
-                          j++;
-                        }
-                      else
-                        {
-                          r->nRecs = r->nRecs - 1;
-                        }
-                      trackpoint = trackpoint->next;
-                    }
-                  track = track->next;
-                }
-              r->plap_start_position_lat[k]
-                  = lap->tracks[0].trackpoints[0].latitude;
-              r->plap_start_position_long[k]
-                  = lap->tracks[0].trackpoints[0].longitude;
-              r->plap_total_elapsed_time[k] = lap->total_time;
-              r->plap_total_distance[k] = lap->distance;
-              k++;
-              lap = lap->next;
-            }
-          r->sess_start_time = parseiso8601utc (activity->started_at);
-          r->sess_timestamp = parseiso8601utc(activity->ended_at);
-          r->sess_start_position_lat = activity->start_point->latitude;
-          r->sess_start_position_long = activity->start_point->longitude;
-          r->sess_total_elapsed_time = activity->total_time;
-          r->sess_total_distance = activity->total_distance;
-          r->sess_total_calories = activity->total_calories;
-          r->sess_avg_speed = r->sess_total_distance / (r->sess_timestamp - r->sess_start_time);
-          r->sess_total_ascent = activity->total_elevation_gain;
-          r->sess_total_descent = activity->total_elevation_loss;
-          r->sess_max_altitude = activity->elevation_maximum;
-          r->sess_min_altitude = activity->elevation_minimum;
-          r->sess_avg_heartrate = activity->heart_rate_average;
-          r->sess_max_heartrate = activity->heart_rate_maximum;
-          r->sess_min_heartrate = activity->heart_rate_minimum;
-          r->sess_avg_cadence = activity->cadence_average;
-          r->sess_max_cadence = activity->cadence_maximum;
-
-          activity = activity->next;
+          c->overflow = 1;
+          return;
         }
-      /* Successful parse. */
-      free (trackpoint);
-      free (track);
-      free (lap);
-      free (activity);
-      free (tcx);
-      return 0;
+      r->lap_start_position_lat[c->k] = trackpoint->latitude;
+      r->lap_start_position_long[c->k] = trackpoint->longitude;
+      c->k++;
+    }
+  /* The activity totals take in every point, bad GPS readings included.
+   * The parser keeps none of them, so the previous one is copied. */
+  calculate_summary_lap (c->tcx, activity, lap, trackpoint);
+  if (c->npoints > 0)
+    calculate_elevation_delta (lap, &c->prev_point, trackpoint);
+  c->prev_point = *trackpoint;
+  c->npoints++;
+  timestamp = parseiso8601 (trackpoint->time, &c->day_cache);
+  c->ended_at = timestamp;
+  /* Check for "bad" GPS readings.  You don't run off the
+   * coast of Africa. */
+  if ((trackpoint->latitude >= -ZERO_THRESHOLD
+       && trackpoint->latitude <= ZERO_THRESHOLD)
+      || (trackpoint->longitude >= -ZERO_THRESHOLD
+          && trackpoint->longitude <= ZERO_THRESHOLD))
+    return;
+  if (j == c->max_recs)
+    {
+      c->overflow = 1;
+      return;
+    }
+  r->rec_time[j] = timestamp;
+  r->rec_distance[j] = (float)trackpoint->distance;
+  /* Carry the previous speed over when the interval
+   * is missing or not positive. */
+  if (!isnan (timestamp) && !isnan (c->prev_timestamp)
+      && timestamp > c->prev_timestamp)
+    {
+      r->rec_speed[j] = ((float)trackpoint->distance - c->prev_distance)
+                        / (timestamp - c->prev_timestamp);
     }
   else
+    {
+      if (j > 0)
+        {
+          r->rec_speed[j] = r->rec_speed[j - 1];
+        }
+      else
+        {
+          r->rec_speed[j] = 1.0; // dummy one up?
+        }
+    }
+  if (r->rec_speed[j] > r->sess.max_speed)
+    {
+      r->sess.max_speed = r->rec_speed[j];
+    }
+  r->rec_altitude[j] = (float)trackpoint->elevation;
+  r->rec_cadence[j] = (float)trackpoint->cadence;
+  r->rec_heartrate[j] = (float)trackpoint->heart_rate;
+  r->rec_lat[j] = (float)trackpoint->latitude;
+  r->rec_long[j] = (float)trackpoint->longitude;
+  c->prev_timestamp = timestamp;
+  c->prev_distance = r->rec_distance[j];
+  c->j = j + 1;
+  if (c->j % TCX_PUBLISH_INTERVAL == 0)
+    activity_progress_publish (c->prog, c->j);
+}
+
+/* Count the start tags of <Trackpoint> and <Lap> elements, in any
+ * namespace, without parsing the document.  Tags inside comments and the
+ * like are counted too, so the counts are never less than the numbers of
+ * elements a parse will find.
+ */
+static void
+tcx_count_elements (const char *data, size_t size, long *ntrackpoints,
+                    long *nlaps)
+{
+  const char *p = data;
+  const char *end = data + size;
+  *ntrackpoints = 0;
+  *nlaps = 0;
+  while ((p = (const char *)memchr (p, '<', end - p)) != NULL)
+    {
+      const char *name = ++p;
+      /* Not end tags, comments, declarations or processing instructions. */
+      if (p == end || *p == '/' || *p == '!' || *p == '?')
+        continue;
+      while (p < end && *p != '>' && *p != '/' && *p != ' ' && *p != '\t'
+             && *p != '\r' && *p != '\n')
+        {
+          if (*p == ':')
+            name = p + 1;
+          p++;
+        }
+      if (p - name == 10 && memcmp (name, "Trackpoint", 10) == 0)
+        (*ntrackpoints)++;
+      else if (p - name == 3 && memcmp (name, "Lap", 3) == 0)
+        (*nlaps)++;
+    }
+}
+
+/* Where parse progress is reported, and the size of the whole input. */
+typedef struct tcx_progress
+{
+  ActivityProgress *prog;
+  int64_t total;
+} tcx_progress_t;
+
+/* tcx_t progress hook: pass progress on, and stop if cancelled. */
+static int
+tcx_report_progress (void *data, long consumed)
+{
+  tcx_progress_t *p = (tcx_progress_t *)data;
+  activity_progress_update (p->prog, consumed, p->total);
+  return activity_progress_cancelled (p->prog);
+}
+
+/* Fill r (initialized by the caller with activity_init) with one session of
+ * a TCX file.  Each <Activity> in the file is a session; the number found is
+ * left in r->nsessions.  Progress is reported through prog, which may be
+ * NULL, and the parse stops early if it is cancelled.  Records are
+ * published through prog as they are parsed.
+ * Returns 0 on success, 1 on failure.
+ */
+int
+create_arrays_from_tcx_file (char *fname, long session, ActivityData *r,
+                             ActivityProgress *prog)
+{
+  activity_t *activity = NULL;
+  long nrecs = 0;
+  long nlaps = 0;
+  r->time_zone_offset = 0;
+
+  /* Parse straight out of a mapping of the file; the tree owns copies of
+   * everything it keeps, so the view can go as soon as parsing is done. */
+  ActivityFileView view;
+  if (activity_view_open (fname, &view) != 0)
+    {
+      activity_view_close (&view);
+      return 1;
+    }
+
+  /* The records are converted, and published, as the parser reads them,
+   * so the columns are sized before it starts and never move.  A count of
+   * start tags is enough for that, and far quicker than a parse; it covers
+   * every session in the file, not just the one selected. */
+  tcx_count_elements (view.data, view.size, &nrecs, &nlaps);
+  if (activity_alloc (r, nrecs, nlaps))
+    {
+      activity_view_close (&view);
+      return 1;
+    }
+
+  tcx_t *tcx = tcx_new ();
+  tcx_progress_t progress = { prog, (int64_t)view.size };
+  if (prog != NULL)
+    {
+      tcx->progress = tcx_report_progress;
+      tcx->progress_data = &progress;
+    }
+  tcx_columns_t columns = { 0 };
+  columns.r = r;
+  columns.tcx = tcx;
+  columns.session = session;
+  columns.prev_timestamp = NAN;
+  columns.ended_at = NAN;
+  columns.max_recs = nrecs;
+  columns.max_laps = nlaps;
+  columns.prog = prog;
+  tcx->trackpoint = tcx_fill_columns;
+  tcx->trackpoint_data = &columns;
+  r->sess.max_speed = 0.0;
+  int failed = parse_tcx_memory_streaming (tcx, view.data, view.size, fname);
+  activity_view_close (&view);
+  if (failed || columns.overflow)
     {
       /* Failed to parse. */
+      tcx_free (tcx);
       return 1;
     }
+
+  /* Find the selected session. */
+  r->nsessions = 0;
+  for (activity = tcx->activities; activity != NULL;
+       activity = activity->next)
+    {
+      r->nsessions++;
+    }
+  activity = tcx->activities;
+  for (long i = 0; activity != NULL && i < session; i++)
+    {
+      activity = activity->next;
+    }
+  if (session < 0 || activity == NULL)
+    {
+      tcx_free (tcx);
+      return 1;
+    }
+  r->session = session;
+  /* Points with bad GPS readings were skipped. */
+  r->nrecs = columns.j;
+  r->nlaps = columns.k;
+  activity_progress_publish (prog, r->nrecs);
+
+  /* Each lap with points has its time and distance, in file order.  The
+   * activity totals are finished off here too; laps without points were
+   * never seen by tcx_fill_columns, so their summaries start now. */
+  long k = 0;
+  if (columns.prev_lap == NULL)
+    calculate_summary_activity_begin (activity);
+  for (lap_t *lap = activity->laps; lap != NULL; lap = lap->next)
+    {
+      if (lap->num_trackpoints == 0)
+        calculate_summary_lap_begin (lap);
+      else if (k < r->nlaps)
+        {
+          r->lap_total_elapsed_time[k] = lap->total_time;
+          r->lap_total_distance[k] = lap->distance;
+          k++;
+        }
+      calculate_summary_lap_end (activity, lap);
+    }
+  calculate_summary_activity_end (activity);
+  /* That was the time of a point which is gone. */
+  activity->ended_at = NULL;
+
+  /* The session summary comes from the activity's totals. */
+  r->sess.start_time = parseiso8601utc (activity->started_at);
+  r->sess.timestamp
+      = isnan (columns.ended_at) ? -1 : (time_t)floor (columns.ended_at);
+  if (activity->start_point != NULL)
+    {
+      r->sess.start_position_lat = activity->start_point->latitude;
+      r->sess.start_position_long = activity->start_point->longitude;
+    }
+  r->sess.total_elapsed_time = activity->total_time;
+  r->sess.total_distance = activity->total_distance;
+  r->sess.total_calories = activity->total_calories;
+  r->sess.avg_speed = r->sess.total_distance
+                      / (r->sess.timestamp - r->sess.start_time);
+  r->sess.total_ascent = activity->total_elevation_gain;
+  r->sess.total_descent = activity->total_elevation_loss;
+  r->sess.max_altitude = activity->elevation_maximum;
+  r->sess.min_altitude = activity->elevation_minimum;
+  r->sess.avg_heartrate = activity->heart_rate_average;
+  r->sess.max_heartrate = activity->heart_rate_maximum;
+  r->sess.min_heartrate = activity->heart_rate_minimum;
+  r->sess.avg_cadence = activity->cadence_average;
+  r->sess.max_cadence = activity->cadence_maximum;
+
+  /* Successful parse. Release the whole tree in one go. */
+  activity_progress_update (prog, progress.total, progress.total);
+  tcx_free (tcx);
+  return 0;
 }
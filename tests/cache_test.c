@@ -0,0 +1,202 @@
+/* Checks that the activity cache gives back what was stored, and only while
+ * it still matches the file it was stored for.
+ *
+ * cache.c is included rather than linked so the checks can reach its
+ * header layout and damage an entry on purpose.
+ */
+#include <dirent.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "cache.c"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                      \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+        {                                                                     \
+          fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);                    \
+          fprintf (stderr, __VA_ARGS__);                                      \
+          fputc ('\n', stderr);                                               \
+          failures++;                                                         \
+        }                                                                     \
+    }                                                                         \
+  while (0)
+
+static char source[256]; // the file whose decode is cached
+static char entries[256]; // the directory the entries go in
+
+static void
+write_source (char first, time_t mtime)
+{
+  FILE *fp = fopen (source, "wb");
+  fputc (first, fp);
+  for (int i = 0; i < 200000; i++)
+    fputc ('a' + i % 26, fp);
+  fclose (fp);
+  struct utimbuf times = { mtime, mtime };
+  utime (source, &times);
+}
+
+/* The path of the single entry in the cache. */
+static void
+entry_path (char *path, size_t size)
+{
+  DIR *dir = opendir (entries);
+  struct dirent *e;
+  path[0] = '\0';
+  while (dir != NULL && (e = readdir (dir)) != NULL)
+    if (strstr (e->d_name, ".act") != NULL)
+      snprintf (path, size, "%s/%s", entries, e->d_name);
+  if (dir != NULL)
+    closedir (dir);
+}
+
+/* Overwrite the entry's bytes at offset. */
+static void
+patch_entry (long offset, const void *data, size_t size)
+{
+  char path[512];
+  entry_path (path, sizeof (path));
+  FILE *fp = fopen (path, "r+b");
+  CHECK (fp != NULL, "no entry to patch");
+  if (fp == NULL)
+    return;
+  fseek (fp, offset, SEEK_SET);
+  fwrite (data, 1, size, fp);
+  fclose (fp);
+}
+
+static int
+load (long session)
+{
+  ActivityData got;
+  activity_init (&got);
+  int missed = cache_load (source, session, &got);
+  activity_free (&got);
+  return missed;
+}
+
+int
+main (void)
+{
+  char dir[] = "/tmp/cache_test_XXXXXX";
+  CHECK (mkdtemp (dir) != NULL, "cannot make a directory to work in");
+  snprintf (source, sizeof (source), "%s/run.tcx", dir);
+  snprintf (entries, sizeof (entries), "%s/siliconsneaker", dir);
+  setenv ("XDG_CACHE_HOME", dir, 1);
+  time_t mtime = 1600000000;
+  write_source ('x', mtime);
+
+  ActivityData act;
+  activity_init (&act);
+  long nrecs = 1001, nlaps = 3;
+  CHECK (activity_alloc (&act, nrecs, nlaps) == 0, "cannot allocate");
+  act.nrecs = nrecs;
+  act.nlaps = nlaps;
+  for (long i = 0; i < nrecs; i++)
+    {
+      act.rec_time[i] = 1600000000.25 + i;
+      act.rec_distance[i] = i * 2.5f;
+      act.rec_speed[i] = 2.5f + i % 7;
+      act.rec_altitude[i] = 100.0f - i % 13;
+      act.rec_cadence[i] = 80 + i % 5;
+      act.rec_heartrate[i] = 120 + i % 40;
+      act.rec_lat[i] = 39.7f + i * 1e-5f;
+      act.rec_long[i] = -84.2f - i * 1e-5f;
+    }
+  for (long i = 0; i < nlaps; i++)
+    {
+      act.lap_total_distance[i] = 1000.0f * (i + 1);
+      act.lap_start_position_lat[i] = 39.7f + i;
+      act.lap_start_position_long[i] = -84.2f - i;
+      act.lap_total_elapsed_time[i] = 300.0f + i;
+    }
+  act.nsessions = 2;
+  act.session = 1;
+  act.time_zone_offset = -14400;
+  act.sess.total_distance = 3000.0f;
+  act.sess.max_heartrate = 159.0f;
+  act.sess.start_time = 1600000000;
+
+  CHECK (cache_store (source, 1, &act) == 0, "cannot store");
+
+  /* A hit gives back every column and field. */
+  ActivityData got;
+  activity_init (&got);
+  CHECK (cache_load (source, 1, &got) == 0, "the fresh entry missed");
+  CHECK (got.nrecs == nrecs && got.nlaps == nlaps && got.nsessions == 2
+             && got.session == 1 && got.time_zone_offset == -14400,
+         "counts differ: %ld records, %ld laps", got.nrecs, got.nlaps);
+  if (got.nrecs == nrecs && got.nlaps == nlaps)
+    {
+#define SAME(col, n)                                                          \
+  CHECK (memcmp (act.col, got.col, (n) * sizeof (*act.col)) == 0,             \
+         #col " differs")
+      SAME (rec_time, nrecs);
+      SAME (rec_distance, nrecs);
+      SAME (rec_speed, nrecs);
+      SAME (rec_altitude, nrecs);
+      SAME (rec_cadence, nrecs);
+      SAME (rec_heartrate, nrecs);
+      SAME (rec_lat, nrecs);
+      SAME (rec_long, nrecs);
+      SAME (lap_total_distance, nlaps);
+      SAME (lap_start_position_lat, nlaps);
+      SAME (lap_start_position_long, nlaps);
+      SAME (lap_total_elapsed_time, nlaps);
+#undef SAME
+    }
+  CHECK (memcmp (&act.sess, &got.sess, sizeof (act.sess)) == 0,
+         "the session summary differs");
+  activity_free (&got);
+
+  /* Another session of the same file has an entry of its own. */
+  CHECK (load (0) != 0, "session 0 hit session 1's entry");
+
+  /* A touched file is stale; touched back, it is the same file again. */
+  write_source ('x', mtime + 10);
+  CHECK (load (1) != 0, "a stale modification time hit");
+  write_source ('x', mtime);
+  CHECK (load (1) == 0, "the restored file missed");
+
+  /* So is one rewritten with the same size and time. */
+  write_source ('y', mtime);
+  CHECK (load (1) != 0, "changed contents hit");
+  write_source ('x', mtime);
+
+  /* Damaged entries miss, however large the counts they claim. */
+  int64_t count = INT64_MAX / 4;
+  patch_entry (offsetof (CacheHeader, nrecs), &count, sizeof (count));
+  CHECK (load (1) != 0, "an entry claiming %ld records hit", (long)count);
+  count = nrecs;
+  patch_entry (offsetof (CacheHeader, nrecs), &count, sizeof (count));
+  CHECK (load (1) == 0, "the repaired entry missed");
+  count = -1;
+  patch_entry (offsetof (CacheHeader, nlaps), &count, sizeof (count));
+  CHECK (load (1) != 0, "an entry claiming -1 laps hit");
+  count = nlaps;
+  patch_entry (offsetof (CacheHeader, nlaps), &count, sizeof (count));
+  char path[512];
+  entry_path (path, sizeof (path));
+  CHECK (truncate (path, sizeof (CacheHeader) + 100) == 0, "cannot truncate");
+  CHECK (load (1) != 0, "a truncated entry hit");
+
+  unsigned long hits, misses;
+  cache_stats (&hits, &misses);
+  CHECK (hits == 3 && misses == 6, "%lu hits and %lu misses, not 3 and 6",
+         hits, misses);
+
+  activity_free (&act);
+  unlink (path);
+  rmdir (entries);
+  unlink (source);
+  rmdir (dir);
+  if (failures > 0)
+    fprintf (stderr, "cache_test: %d failures\n", failures);
+  return failures > 0;
+}
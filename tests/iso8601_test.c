@@ -0,0 +1,110 @@
+/* Checks the ISO 8601 timestamp parser used for TCX files. */
+#define _GNU_SOURCE // timegm
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tcxwrapper.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                      \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+        {                                                                     \
+          fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);                    \
+          fprintf (stderr, __VA_ARGS__);                                      \
+          fputc ('\n', stderr);                                               \
+          failures++;                                                         \
+        }                                                                     \
+    }                                                                         \
+  while (0)
+
+static void
+check_time (const char *date, double expected)
+{
+  double t = parseiso8601 (date, NULL);
+  CHECK (t == expected, "\"%s\" is %.3f, not %.3f", date, t, expected);
+}
+
+static void
+check_malformed (const char *date)
+{
+  CHECK (isnan (parseiso8601 (date, NULL)), "\"%s\" was accepted", date);
+  CHECK (parseiso8601utc (date) == -1, "\"%s\" was accepted as UTC", date);
+}
+
+int
+main (void)
+{
+  /* 2021-05-02T12:00:00Z, written every way the parser takes. */
+  double noon = 1619956800.0;
+  check_time ("2021-05-02T12:00:00Z", noon);
+  check_time ("2021-05-02T12:00:00", noon);
+  check_time ("2021-05-02t12:00:00z", noon);
+  check_time ("2021-05-02 12:00:00Z", noon);
+  check_time ("2021-05-02T14:00:00+02:00", noon);
+  check_time ("2021-05-02T14:00:00+0200", noon);
+  check_time ("2021-05-02T14:00:00+02", noon);
+  check_time ("2021-05-02T06:30:00-05:30", noon);
+  check_time ("2021-05-03T01:45:00+13:45", noon);
+
+  /* Fractions of a second are kept, and dropped by parseiso8601utc. */
+  check_time ("2021-05-02T12:00:00.5Z", noon + 0.5);
+  check_time ("2021-05-02T12:00:00,25Z", noon + 0.25);
+  check_time ("2021-05-02T14:00:00.750+02:00", noon + 0.75);
+  check_time ("2021-05-02T12:00:00.Z", noon);
+  CHECK (parseiso8601utc ("2021-05-02T12:00:00.999Z") == (time_t)noon,
+         "parseiso8601utc did not drop the fraction");
+  CHECK (parseiso8601utc ("1969-12-31T23:59:59.5Z") == -1,
+         "parseiso8601utc did not round down before the epoch");
+
+  /* Calendar edges. */
+  check_time ("1970-01-01T00:00:00Z", 0.0);
+  check_time ("1969-12-31T23:59:59Z", -1.0);
+  check_time ("2000-02-29T00:00:00Z", 951782400.0);
+  check_time ("2100-03-01T00:00:00Z", 4107542400.0);
+  check_time ("2021-01-01T00:00:00+01:00", 1609455600.0);
+
+  /* Every day for 400 years against the C library, through one cache as
+   * a file's trackpoints would be, with a few days skipped and revisited.
+   */
+  iso8601_cache_t cache = { 0 };
+  for (long day = -3650; day < 146097 - 3650; day += 1 + (day & 1))
+    {
+      time_t when = day * 86400 + labs (day * 7919) % 86400;
+      struct tm tm;
+      gmtime_r (&when, &tm);
+      char date[32];
+      strftime (date, sizeof (date), "%Y-%m-%dT%H:%M:%SZ", &tm);
+      double t = parseiso8601 (date, &cache);
+      CHECK (t == (double)timegm (&tm), "\"%s\" is %.0f, not %ld", date, t,
+             (long)timegm (&tm));
+      t = parseiso8601 ("1999-12-31T23:59:59Z", &cache);
+      CHECK (t == 946684799.0, "the cache kept a stale day after \"%s\"",
+             date);
+    }
+
+  check_malformed (NULL);
+  check_malformed ("");
+  check_malformed ("2021-05-02");
+  check_malformed ("2021-05-02T12:00");
+  check_malformed ("2021-05-02T12:00:0");
+  check_malformed ("2021/05/02T12:00:00Z");
+  check_malformed ("2021-05-02X12:00:00Z");
+  check_malformed ("2021-13-02T12:00:00Z");
+  check_malformed ("2021-00-02T12:00:00Z");
+  check_malformed ("2021-05-32T12:00:00Z");
+  check_malformed ("2021-05-00T12:00:00Z");
+  check_malformed ("20x1-05-02T12:00:00Z");
+  check_malformed ("2021-05-02T1a:00:00Z");
+  check_malformed ("2021-05-02T12:00:00+2");
+  check_malformed ("2021-05-02T12:00:00+02:x0");
+  check_malformed ("2021-05-02T12:00:00-");
+
+  if (failures > 0)
+    fprintf (stderr, "iso8601_test: %d failures\n", failures);
+  return failures > 0;
+}
@@ -0,0 +1,178 @@
+/* Checks the level-of-detail pyramid against a brute-force search.
+ *
+ * Every bucket of every level must hold the first lowest and first highest
+ * sample of its span, whether the pyramid was built at once or extended a
+ * little at a time, and decimating a range must keep that range's extremes.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lod.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                      \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+        {                                                                     \
+          fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);                    \
+          fprintf (stderr, __VA_ARGS__);                                      \
+          fputc ('\n', stderr);                                               \
+          failures++;                                                         \
+        }                                                                     \
+    }                                                                         \
+  while (0)
+
+/* Index of the first lowest (or highest) y in [from, to). */
+static long
+brute_extreme (const PLFLT *y, long from, long to, int highest)
+{
+  long best = from;
+  for (long i = from + 1; i < to; i++)
+    if (highest ? y[i] > y[best] : y[i] < y[best])
+      best = i;
+  return best;
+}
+
+/* Compare every bucket of lod with a search of the samples it covers. */
+static void
+check_pyramid (const LodPyramid *lod, const PLFLT *y, long n)
+{
+  CHECK (lod != NULL, "no pyramid for %ld samples", n);
+  if (lod == NULL)
+    return;
+  CHECK (lod->n == n, "pyramid covers %ld samples, not %ld", lod->n, n);
+  for (int k = 0; k < lod->nlevels; k++)
+    {
+      const LodLevel *lv = &lod->level[k];
+      long span = 2L << k;
+      CHECK (lv->nbuckets == (n + span - 1) / span,
+             "level %d has %ld buckets for %ld samples", k, lv->nbuckets, n);
+      for (long b = 0; b < lv->nbuckets; b++)
+        {
+          long from = b * span;
+          long to = from + span < n ? from + span : n;
+          long lo = brute_extreme (y, from, to, 0);
+          long hi = brute_extreme (y, from, to, 1);
+          CHECK (lv->imin[b] == lo, "n %ld level %d bucket %ld: min at %ld, "
+                 "not %ld", n, k, b, lv->imin[b], lo);
+          CHECK (lv->imax[b] == hi, "n %ld level %d bucket %ld: max at %ld, "
+                 "not %ld", n, k, b, lv->imax[b], hi);
+        }
+    }
+  CHECK (n <= 1 || lod->level[lod->nlevels - 1].nbuckets == 1,
+         "top level of %ld samples is not a single bucket", n);
+}
+
+/* Decimate [xmin, xmax] and check the points against the samples. */
+static void
+check_decimate (const LodPyramid *lod, const PLFLT *x, const PLFLT *y,
+                PLFLT xmin, PLFLT xmax, long columns)
+{
+  long n = lod->n;
+  PLFLT *outx = (PLFLT *)malloc (LOD_POINTS (columns) * sizeof (PLFLT));
+  PLFLT *outy = (PLFLT *)malloc (LOD_POINTS (columns) * sizeof (PLFLT));
+  long m = lod_decimate (lod, x, y, xmin, xmax, columns, outx, outy);
+  CHECK (m <= LOD_POINTS (columns), "%ld points for %ld columns", m, columns);
+
+  /* The points are samples, in order. */
+  long at = 0;
+  for (long i = 0; i < m; i++)
+    {
+      while (at < n && !(x[at] == outx[i] && y[at] == outy[i]))
+        at++;
+      CHECK (at < n, "point %ld (%g, %g) is not a later sample", i, outx[i],
+             outy[i]);
+      at++;
+    }
+
+  /* The lowest and highest samples in view survive. */
+  long from = 0, to = n;
+  while (from < n && x[from] < xmin)
+    from++;
+  while (to > from && x[to - 1] > xmax)
+    to--;
+  if (to > from)
+    {
+      PLFLT lo = y[brute_extreme (y, from, to, 0)];
+      PLFLT hi = y[brute_extreme (y, from, to, 1)];
+      int found_lo = 0, found_hi = 0;
+      for (long i = 0; i < m; i++)
+        {
+          found_lo |= outy[i] == lo;
+          found_hi |= outy[i] == hi;
+        }
+      CHECK (found_lo && found_hi, "extremes of [%g, %g] lost in %ld points",
+             xmin, xmax, m);
+    }
+  free (outx);
+  free (outy);
+}
+
+int
+main (void)
+{
+  long size = 50000;
+  PLFLT *x = (PLFLT *)malloc (size * sizeof (PLFLT));
+  PLFLT *y = (PLFLT *)malloc (size * sizeof (PLFLT));
+  srand (1);
+  for (long i = 0; i < size; i++)
+    {
+      /* Repeated x and repeated y, to exercise the ties. */
+      x[i] = i / 3;
+      y[i] = (rand () % 200) + sin (i * 0.01) * 50;
+    }
+
+  /* Built at once. */
+  long sizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 100, 1023, 1024, 1025, size };
+  for (size_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+    {
+      LodPyramid *lod = lod_build (x, y, sizes[s]);
+      check_pyramid (lod, y, sizes[s]);
+      lod_free (lod);
+    }
+
+  /* Extended a little, then a lot, at a time. */
+  for (int trial = 0; trial < 4; trial++)
+    {
+      LodPyramid *lod = lod_build (x, y, 0);
+      long n = 0;
+      while (n < size && lod != NULL)
+        {
+          n += 1 + rand () % (trial < 2 ? 9 : 5000);
+          if (n > size)
+            n = size;
+          lod = lod_extend (lod, x, y, n);
+          if (trial < 2 && n > 2000)
+            break;
+          if (trial >= 2 || n % 7 == 0)
+            check_pyramid (lod, y, n);
+        }
+      check_pyramid (lod, y, n);
+
+      for (int w = 0; lod != NULL && w < 200; w++)
+        {
+          PLFLT a = x[rand () % n], b = x[rand () % n];
+          long columns = 1 + rand () % 400;
+          check_decimate (lod, x, y, a < b ? a : b, a < b ? b : a, columns);
+        }
+      lod_free (lod);
+    }
+
+  /* x out of order, or NaN, gets no pyramid. */
+  PLFLT saved = x[150];
+  x[150] = -1;
+  CHECK (lod_extend (lod_build (x, y, 100), x, y, 200) == NULL,
+         "decreasing x was extended");
+  x[150] = NAN;
+  CHECK (lod_build (x, y, 200) == NULL, "NaN x was built");
+  x[150] = saved;
+
+  free (x);
+  free (y);
+  if (failures > 0)
+    fprintf (stderr, "lod_test: %d failures\n", failures);
+  return failures > 0;
+}
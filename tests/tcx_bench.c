@@ -0,0 +1,66 @@
+/* Time one way of reading a TCX file and report the memory it took.
+ *
+ *   tcx_bench dom|stream|load FILE
+ *
+ * dom and stream build the whole tree, with parse_tcx_file and
+ * parse_tcx_file_streaming, and then summarize it.  load is the
+ * application's own path, create_arrays_from_tcx_file, which converts the
+ * points as they are read and keeps none of them.  Peak sizes only compare
+ * between runs in separate processes, which is how "make bench" runs them.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "activity.h"
+#include "tcx.h"
+#include "tcxwrapper.h"
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc != 3
+      || (strcmp (argv[1], "dom") != 0 && strcmp (argv[1], "stream") != 0
+          && strcmp (argv[1], "load") != 0))
+    {
+      fprintf (stderr, "usage: %s dom|stream|load FILE\n", argv[0]);
+      return 2;
+    }
+  char *mode = argv[1];
+  char *fname = argv[2];
+  int failed;
+  double start = now ();
+  if (strcmp (mode, "load") == 0)
+    {
+      ActivityData r;
+      activity_init (&r);
+      failed = create_arrays_from_tcx_file (fname, 0, &r, NULL);
+      activity_free (&r);
+    }
+  else
+    {
+      tcx_t *tcx = tcx_new ();
+      if (strcmp (mode, "dom") == 0)
+        failed = parse_tcx_file (tcx, fname);
+      else
+        failed = parse_tcx_file_streaming (tcx, fname);
+      if (!failed)
+        calculate_summary (tcx);
+      tcx_free (tcx);
+    }
+  double elapsed = now () - start;
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  printf ("%-6s %8.3f s %10ld KiB peak%s\n", mode, elapsed, usage.ru_maxrss,
+          failed ? " (failed)" : "");
+  return failed;
+}
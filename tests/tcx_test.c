@@ -0,0 +1,273 @@
+/* Checks the streaming TCX reader against the DOM parser on a fixture.
+ *
+ * Both must build the same tree.  With a trackpoint hook set, the streaming
+ * reader must pass the same points in file order, with the activity and lap
+ * each belongs to, and keep their counts but not the points themselves.
+ *
+ *   tcx_test [FILE]   (tests/sample.tcx by default)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tcx.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                      \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+        {                                                                     \
+          fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);                    \
+          fprintf (stderr, __VA_ARGS__);                                      \
+          fputc ('\n', stderr);                                               \
+          failures++;                                                         \
+        }                                                                     \
+    }                                                                         \
+  while (0)
+
+static int
+same_string (const char *a, const char *b)
+{
+  return (a == NULL && b == NULL)
+         || (a != NULL && b != NULL && strcmp (a, b) == 0);
+}
+
+static void
+compare_trackpoints (const trackpoint_t *a, const trackpoint_t *b,
+                     const char *where)
+{
+  CHECK (same_string (a->time, b->time), "%s: time %s, not %s", where,
+         b->time, a->time);
+  CHECK (a->latitude == b->latitude && a->longitude == b->longitude,
+         "%s: position %f,%f, not %f,%f", where, b->latitude, b->longitude,
+         a->latitude, a->longitude);
+  CHECK (a->elevation == b->elevation, "%s: elevation %f, not %f", where,
+         b->elevation, a->elevation);
+  CHECK (a->distance == b->distance, "%s: distance %f, not %f", where,
+         b->distance, a->distance);
+  CHECK (a->heart_rate == b->heart_rate, "%s: heart rate %d, not %d", where,
+         b->heart_rate, a->heart_rate);
+  CHECK (a->cadence == b->cadence, "%s: cadence %d, not %d", where,
+         b->cadence, a->cadence);
+  CHECK (a->speed == b->speed, "%s: speed %f, not %f", where, b->speed,
+         a->speed);
+  CHECK (a->power == b->power, "%s: power %d, not %d", where, b->power,
+         a->power);
+}
+
+/* Compare the tree b with the tree a; b's points are only compared if
+ * points is set, as a hooked parse keeps none.
+ */
+static void
+compare_trees (const tcx_t *a, const tcx_t *b, int points)
+{
+  const activity_t *aa = a->activities, *ba = b->activities;
+  char where[64];
+  for (int i = 0; aa != NULL || ba != NULL; i++)
+    {
+      CHECK (aa != NULL && ba != NULL, "activity %d is in only one tree", i);
+      if (aa == NULL || ba == NULL)
+        return;
+      CHECK (aa->num_laps == ba->num_laps, "activity %d: %d laps, not %d", i,
+             ba->num_laps, aa->num_laps);
+      CHECK (aa->num_trackpoints == ba->num_trackpoints,
+             "activity %d: %d points, not %d", i, ba->num_trackpoints,
+             aa->num_trackpoints);
+      const lap_t *al = aa->laps, *bl = ba->laps;
+      for (int j = 0; al != NULL && bl != NULL; j++)
+        {
+          snprintf (where, sizeof (where), "activity %d lap %d", i, j);
+          CHECK (same_string (al->start_time, bl->start_time)
+                     && al->total_time == bl->total_time
+                     && al->distance == bl->distance
+                     && al->calories == bl->calories
+                     && same_string (al->intensity, bl->intensity),
+                 "%s: fields differ", where);
+          CHECK (al->num_tracks == bl->num_tracks
+                     && al->num_trackpoints == bl->num_trackpoints,
+                 "%s: %d tracks of %d points, not %d of %d", where,
+                 bl->num_tracks, bl->num_trackpoints, al->num_tracks,
+                 al->num_trackpoints);
+          const track_t *at = al->tracks, *bt = bl->tracks;
+          for (int k = 0; at != NULL && bt != NULL; k++)
+            {
+              CHECK (at->num_trackpoints == bt->num_trackpoints,
+                     "%s track %d: %d points, not %d", where, k,
+                     bt->num_trackpoints, at->num_trackpoints);
+              if (points)
+                {
+                  const trackpoint_t *ap = at->trackpoints;
+                  const trackpoint_t *bp = bt->trackpoints;
+                  for (int m = 0; ap != NULL && bp != NULL; m++)
+                    {
+                      char point[128];
+                      snprintf (point, sizeof (point), "%s track %d point %d",
+                                where, k, m);
+                      compare_trackpoints (ap, bp, point);
+                      ap = ap->next;
+                      bp = bp->next;
+                    }
+                  CHECK (ap == NULL && bp == NULL,
+                         "%s track %d: the point lists differ in length",
+                         where, k);
+                }
+              else
+                CHECK (bt->trackpoints == NULL,
+                       "%s track %d: a hooked parse kept its points", where,
+                       k);
+              at = at->next;
+              bt = bt->next;
+            }
+          CHECK (at == NULL && bt == NULL, "%s: track lists differ", where);
+          al = al->next;
+          bl = bl->next;
+        }
+      CHECK (al == NULL && bl == NULL, "activity %d: lap lists differ", i);
+      aa = aa->next;
+      ba = ba->next;
+    }
+}
+
+/* A point of the DOM tree, with where it is. */
+typedef struct dom_point
+{
+  int activity;
+  int lap;
+  const trackpoint_t *point;
+} dom_point_t;
+
+/* What the hook compares the points it is passed with. */
+typedef struct hook_check
+{
+  const tcx_t *hooked;
+  dom_point_t *expected; // the DOM tree's points, in file order
+  int nexpected;
+  int seen;
+} hook_check_t;
+
+static void
+check_hooked_point (void *data, activity_t *activity, lap_t *lap,
+                    trackpoint_t *trackpoint)
+{
+  hook_check_t *h = (hook_check_t *)data;
+  int n = h->seen++;
+  char where[64];
+  snprintf (where, sizeof (where), "hooked point %d", n);
+  CHECK (n < h->nexpected, "%s: the DOM tree has only %d", where,
+         h->nexpected);
+  if (n >= h->nexpected)
+    return;
+  int ai = 0, li = 0;
+  for (const activity_t *a = h->hooked->activities; a != activity;
+       a = a->next)
+    ai++;
+  for (const lap_t *l = activity->laps; l != lap; l = l->next)
+    li++;
+  CHECK (ai == h->expected[n].activity && li == h->expected[n].lap,
+         "%s: in activity %d lap %d, not %d lap %d", where, ai, li,
+         h->expected[n].activity, h->expected[n].lap);
+  compare_trackpoints (h->expected[n].point, trackpoint, where);
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *fname = argc > 1 ? argv[1] : "tests/sample.tcx";
+
+  tcx_t *dom = tcx_new ();
+  tcx_t *stream = tcx_new ();
+  CHECK (parse_tcx_file (dom, fname) == 0, "DOM parse of %s failed", fname);
+  CHECK (parse_tcx_file_streaming (stream, fname) == 0,
+         "streaming parse of %s failed", fname);
+  compare_trees (dom, stream, 1);
+
+  /* As the fixture has it: the course's lap is in neither activity. */
+  const activity_t *a = dom->activities;
+  CHECK (a != NULL && a->next != NULL && a->next->next == NULL,
+         "the fixture should have two activities");
+  if (a != NULL && a->next != NULL)
+    {
+      CHECK (a->num_laps == 3 && a->num_trackpoints == 6,
+             "activity 0: %d laps of %d points, not 3 of 6", a->num_laps,
+             a->num_trackpoints);
+      CHECK (a->next->num_laps == 1 && a->next->num_trackpoints == 2,
+             "activity 1: %d laps of %d points, not 1 of 2",
+             a->next->num_laps, a->next->num_trackpoints);
+    }
+
+  /* The summaries agree too. */
+  calculate_summary (dom);
+  calculate_summary (stream);
+  const activity_t *da = dom->activities, *sa = stream->activities;
+  for (int i = 0; da != NULL && sa != NULL; i++)
+    {
+      CHECK (same_string (da->started_at, sa->started_at)
+                 && same_string (da->ended_at, sa->ended_at)
+                 && da->total_time == sa->total_time
+                 && da->total_distance == sa->total_distance
+                 && da->total_calories == sa->total_calories
+                 && da->total_elevation_gain == sa->total_elevation_gain
+                 && da->total_elevation_loss == sa->total_elevation_loss
+                 && da->heart_rate_average == sa->heart_rate_average
+                 && da->cadence_maximum == sa->cadence_maximum,
+             "activity %d: summaries differ", i);
+      da = da->next;
+      sa = sa->next;
+    }
+  if (dom->activities != NULL)
+    CHECK (dom->activities->total_distance == 100.5
+               && dom->activities->total_time == 35.0
+               && dom->activities->total_calories == 12,
+           "activity 0: %.1f m in %.1f s and %d kcal, not 100.5, 35, 12",
+           dom->activities->total_distance, dom->activities->total_time,
+           dom->activities->total_calories);
+
+  /* A hooked parse sees the same points and keeps none. */
+  hook_check_t h = { NULL, NULL, 0, 0 };
+  for (const activity_t *a = dom->activities; a != NULL; a = a->next)
+    h.nexpected += a->num_trackpoints;
+  h.expected = (dom_point_t *)calloc (h.nexpected + 1, sizeof (dom_point_t));
+  int n = 0, ai = 0;
+  for (const activity_t *a = dom->activities; a != NULL; a = a->next, ai++)
+    {
+      int li = 0;
+      for (const lap_t *l = a->laps; l != NULL; l = l->next, li++)
+        for (const track_t *t = l->tracks; t != NULL; t = t->next)
+          for (const trackpoint_t *p = t->trackpoints; p != NULL; p = p->next)
+            h.expected[n++] = (dom_point_t){ ai, li, p };
+    }
+  tcx_t *hooked = tcx_new ();
+  h.hooked = hooked;
+  hooked->trackpoint = check_hooked_point;
+  hooked->trackpoint_data = &h;
+  CHECK (parse_tcx_file_streaming (hooked, fname) == 0,
+         "hooked parse of %s failed", fname);
+  CHECK (h.seen == h.nexpected, "the hook saw %d points, not %d", h.seen,
+         h.nexpected);
+  compare_trees (dom, hooked, 0);
+  free (h.expected);
+
+  /* So does one from memory. */
+  FILE *fp = fopen (fname, "rb");
+  CHECK (fp != NULL, "cannot open %s", fname);
+  if (fp != NULL)
+    {
+      char buffer[65536];
+      size_t size = fread (buffer, 1, sizeof (buffer), fp);
+      fclose (fp);
+      tcx_t *memory = tcx_new ();
+      CHECK (parse_tcx_memory_streaming (memory, buffer, size, fname) == 0,
+             "parse of %s from memory failed", fname);
+      compare_trees (dom, memory, 1);
+      tcx_free (memory);
+    }
+
+  tcx_free (hooked);
+  tcx_free (stream);
+  tcx_free (dom);
+  if (failures > 0)
+    fprintf (stderr, "tcx_test: %d failures\n", failures);
+  return failures > 0;
+}